@@ -0,0 +1,81 @@
+// Meta tag date parsing: the old std::regex and timegm version against DateToTimestamp.
+
+#include "../src/timer.h"
+#include "../src/util.h"
+
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <stdexcept>
+
+namespace {
+
+uint64_t DateToTimestampWithRegex(const std::string& date) {
+    std::regex ex("(\\d\\d\\d\\d)-(\\d\\d)-(\\d\\d)T(\\d\\d):(\\d\\d):(\\d\\d)([+-])(\\d\\d):(\\d\\d)");
+    std::smatch what;
+    if (!std::regex_match(date, what, ex) || what.size() < 10) {
+        throw std::runtime_error("wrong date format");
+    }
+    std::tm t = {};
+    t.tm_sec = std::stoi(what[6]);
+    t.tm_min = std::stoi(what[5]);
+    t.tm_hour = std::stoi(what[4]);
+    t.tm_mday = std::stoi(what[3]);
+    t.tm_mon = std::stoi(what[2]) - 1;
+    t.tm_year = std::stoi(what[1]) - 1900;
+
+    time_t timestamp = timegm(&t);
+    uint64_t zone_ts = std::stoi(what[8]) * 60 * 60 + std::stoi(what[9]) * 60;
+    if (what[7] == "+") {
+        timestamp = timestamp - zone_ts;
+    } else if (what[7] == "-") {
+        timestamp = timestamp + zone_ts;
+    }
+    return timestamp > 0 ? timestamp : 0;
+}
+
+std::vector<std::string> MakeDates(size_t count) {
+    std::mt19937 generator(42);
+    auto next = [&generator](unsigned limit) {
+        return static_cast<unsigned>(generator() % limit);
+    };
+    std::vector<std::string> dates;
+    char buffer[32];
+    for (size_t i = 0; i < count; i++) {
+        std::snprintf(buffer, sizeof(buffer), "%04u-%02u-%02uT%02u:%02u:%02u%c%02u:00",
+            2000 + next(21), 1 + next(12), 1 + next(28), next(24), next(60), next(60),
+            next(2) ? '+' : '-', next(12));
+        dates.push_back(buffer);
+    }
+    return dates;
+}
+
+} // namespace
+
+int main() {
+    const std::vector<std::string> dates = MakeDates(100000);
+
+    uint64_t oldSum = 0;
+    TTimer<std::chrono::high_resolution_clock, std::chrono::microseconds> timer;
+    for (const std::string& date : dates) {
+        oldSum += DateToTimestampWithRegex(date);
+    }
+    const double oldTime = timer.Elapsed();
+
+    uint64_t newSum = 0;
+    timer.Reset();
+    for (const std::string& date : dates) {
+        newSum += DateToTimestamp(date);
+    }
+    const double newTime = timer.Elapsed();
+
+    if (oldSum != newSum) {
+        throw std::runtime_error("Timestamp mismatch");
+    }
+    std::cout << dates.size() << " dates: "
+        << "regex " << oldTime * 1000.0 / dates.size() << " ns, "
+        << "hand-written " << newTime * 1000.0 / dates.size() << " ns" << std::endl;
+    return 0;
+}
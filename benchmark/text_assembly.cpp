@@ -0,0 +1,113 @@
+// Text and link collection from a tinyxml2 article: the old recursive
+// GetFullText/ParseLinksFromText against AppendFullText.
+
+#include "../src/document.h"
+#include "../src/timer.h"
+
+#include <tinyxml2/tinyxml2.h>
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+std::string GetFullText(const tinyxml2::XMLElement* element) {
+    if (const tinyxml2::XMLText* textNode = element->ToText()) {
+        return textNode->Value();
+    }
+    std::string text;
+    const tinyxml2::XMLNode* node = element->FirstChild();
+    while (node) {
+        if (const tinyxml2::XMLElement* elementNode = node->ToElement()) {
+            text += GetFullText(elementNode);
+        } else if (const tinyxml2::XMLText* textNode = node->ToText()) {
+            text += textNode->Value();
+        }
+        node = node->NextSibling();
+    }
+    return text;
+}
+
+void ParseLinksFromText(const tinyxml2::XMLElement* element, std::vector<std::string>& links) {
+    const tinyxml2::XMLNode* node = element->FirstChild();
+    while (node) {
+        if (const tinyxml2::XMLElement* nodeElement = node->ToElement()) {
+            if (std::strcmp(nodeElement->Value(), "a") == 0 && nodeElement->Attribute("href")) {
+                links.push_back(nodeElement->Attribute("href"));
+            }
+            ParseLinksFromText(nodeElement, links);
+        }
+        node = node->NextSibling();
+    }
+}
+
+std::string MakeArticle(size_t paragraphs, size_t nesting, size_t wordsPerLevel) {
+    std::string html = "<article>";
+    for (size_t i = 0; i < paragraphs; i++) {
+        html += "<p>";
+        for (size_t depth = 0; depth < nesting; depth++) {
+            html += (depth % 4 == 3) ? "<a href=\"http://example.com/\">" : "<span>";
+            for (size_t word = 0; word < wordsPerLevel; word++) {
+                html += "word ";
+            }
+        }
+        for (size_t depth = nesting; depth > 0; depth--) {
+            html += ((depth - 1) % 4 == 3) ? "</a>" : "</span>";
+        }
+        html += "</p>";
+    }
+    html += "</article>";
+    return html;
+}
+
+void Run(const char* name, const std::string& html, size_t iterations) {
+    tinyxml2::XMLDocument doc;
+    if (doc.Parse(html.c_str(), html.size()) != tinyxml2::XML_SUCCESS) {
+        throw std::runtime_error("Bad benchmark html");
+    }
+    const tinyxml2::XMLElement* article = doc.FirstChildElement("article");
+
+    std::string oldText;
+    std::vector<std::string> oldLinks;
+    TTimer<std::chrono::high_resolution_clock, std::chrono::microseconds> timer;
+    for (size_t i = 0; i < iterations; i++) {
+        oldText.clear();
+        oldLinks.clear();
+        for (const tinyxml2::XMLElement* p = article->FirstChildElement("p"); p; p = p->NextSiblingElement("p")) {
+            std::string pText = GetFullText(p);
+            oldText += pText + "\n";
+            ParseLinksFromText(p, oldLinks);
+        }
+    }
+    const double oldTime = timer.Elapsed();
+
+    std::string newText;
+    std::vector<std::string> newLinks;
+    timer.Reset();
+    for (size_t i = 0; i < iterations; i++) {
+        newText.clear();
+        newLinks.clear();
+        for (const tinyxml2::XMLElement* p = article->FirstChildElement("p"); p; p = p->NextSiblingElement("p")) {
+            AppendFullText(p, newText, &newLinks);
+            newText += '\n';
+        }
+    }
+    const double newTime = timer.Elapsed();
+
+    if (oldText != newText || oldLinks != newLinks) {
+        throw std::runtime_error("Text assembly mismatch");
+    }
+    std::cout << name << ": " << html.size() << " bytes, "
+        << "recursive " << oldTime / iterations << " us, "
+        << "append " << newTime / iterations << " us" << std::endl;
+}
+
+} // namespace
+
+int main() {
+    Run("flat", MakeArticle(/* paragraphs */ 50, /* nesting */ 1, /* wordsPerLevel */ 20), 2000);
+    Run("deeply nested", MakeArticle(5, 90, 2), 2000);
+    Run("very long", MakeArticle(5000, 4, 10), 20);
+    return 0;
+}
@@ -0,0 +1,90 @@
+import argparse
+import json
+import subprocess
+import time
+from collections import defaultdict
+
+
+def run_top(binary, input_path, extra_args):
+    command = [binary, "top", input_path] + extra_args
+    start = time.time()
+    output = subprocess.run(command, check=True, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL).stdout
+    return json.loads(output), time.time() - start
+
+
+def parse_top(top):
+    # Article to its thread and category, threads are numbered by their order in the "any" rubric
+    article_to_thread = dict()
+    article_to_category = dict()
+    rubric_tops = dict()
+    for rubric in top:
+        titles = [thread["title"] for thread in rubric["threads"]]
+        rubric_tops[rubric["category"]] = titles
+        if rubric["category"] != "any":
+            continue
+        for thread_index, thread in enumerate(rubric["threads"]):
+            for article in thread["articles"]:
+                article_to_thread[article] = thread_index
+                article_to_category[article] = thread["category"]
+    return article_to_thread, article_to_category, rubric_tops
+
+
+def bcubed(expected, predicted):
+    # B-cubed precision and recall of the predicted threads over the articles both outputs have
+    articles = set(expected.keys()) & set(predicted.keys())
+    expected_threads = defaultdict(set)
+    predicted_threads = defaultdict(set)
+    for article in articles:
+        expected_threads[expected[article]].add(article)
+        predicted_threads[predicted[article]].add(article)
+    precision = 0.0
+    recall = 0.0
+    for article in articles:
+        expected_thread = expected_threads[expected[article]]
+        predicted_thread = predicted_threads[predicted[article]]
+        common = len(expected_thread & predicted_thread)
+        precision += common / len(predicted_thread)
+        recall += common / len(expected_thread)
+    if not articles:
+        return 0.0, 0.0, 0.0
+    precision /= len(articles)
+    recall /= len(articles)
+    f1 = 2 * precision * recall / (precision + recall) if precision + recall > 0 else 0.0
+    return precision, recall, f1
+
+
+def main(binary, input_path, consumer, limits, top_size, extra_args):
+    option = "--category_max_tokens" if consumer == "category" else "--vector_max_tokens"
+    # The canonical output: classifier reads everything, embedder as much as the clustering needs
+    baseline, baseline_time = run_top(binary, input_path, extra_args)
+    base_threads, base_categories, base_tops = parse_top(baseline)
+
+    print("| {} | time, s | articles | category changed | B3 precision | B3 recall | B3 F1 | top-{} kept |".format(
+        option, top_size))
+    print("|---|---|---|---|---|---|---|---|")
+    print("| canonical | {:.1f} | {} | - | - | - | - | - |".format(baseline_time, len(base_threads)))
+    for limit in limits:
+        top, elapsed = run_top(binary, input_path, extra_args + [option, str(limit)])
+        threads, categories, tops = parse_top(top)
+        common = set(base_categories.keys()) & set(categories.keys())
+        changed = sum(base_categories[a] != categories[a] for a in common) / max(len(common), 1)
+        precision, recall, f1 = bcubed(base_threads, threads)
+        kept = []
+        for rubric, titles in base_tops.items():
+            expected = set(titles[:top_size])
+            if expected:
+                kept.append(len(expected & set(tops.get(rubric, [])[:top_size])) / len(expected))
+        kept = sum(kept) / max(len(kept), 1)
+        print("| {} | {:.1f} | {} | {:.2%} | {:.4f} | {:.4f} | {:.4f} | {:.2%} |".format(
+            limit, elapsed, len(threads), changed, precision, recall, f1, kept))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="How the top output changes with the token limits")
+    parser.add_argument("--binary", type=str, default="./build/tgnews")
+    parser.add_argument("--input", type=str, required=True)
+    parser.add_argument("--consumer", type=str, choices=("category", "vector"), default="category")
+    parser.add_argument("--limits", type=int, nargs="+", default=[25, 50, 100, 200, 400, 800])
+    parser.add_argument("--top-size", type=int, default=10)
+    args, extra_args = parser.parse_known_args()
+    main(args.binary, args.input, args.consumer, args.limits, args.top_size, extra_args)
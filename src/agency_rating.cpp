@@ -28,6 +28,23 @@ void TAgencyRating::Load(const std::string& filePath, bool setMinAsUnk) {
 }
 
 double TAgencyRating::ScoreUrl(const std::string& url) const {
-    const auto iter = Records.find(GetHost(url));
+    return ScoreHost(GetHost(url));
+}
+
+double TAgencyRating::ScoreHost(const std::string& host) const {
+    const auto iter = Records.find(host);
     return (iter != Records.end()) ? iter->second : UnkRating;
 }
+
+uint32_t THostTable::Add(const std::string& url) {
+    std::string host = ::GetHost(url);
+    const auto iter = Ids.find(host);
+    if (iter != Ids.end()) {
+        return iter->second;
+    }
+    const uint32_t id = Hosts.size();
+    Scores.push_back(AgencyRating.ScoreHost(host));
+    Ids.emplace(host, id);
+    Hosts.push_back(std::move(host));
+    return id;
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 class TAgencyRating {
 public:
@@ -12,8 +14,31 @@ public:
 
     void Load(const std::string& fileName, bool setMinAsUnk = false);
     double ScoreUrl(const std::string& url) const;
+    double ScoreHost(const std::string& host) const;
 
 private:
      std::unordered_map<std::string, double> Records;
      double UnkRating = 0.000015;
 };
+
+// Interns the hosts of all documents into dense ids.
+// The agency score of every host is looked up once, when it is added.
+class THostTable {
+public:
+    explicit THostTable(const TAgencyRating& agencyRating)
+        : AgencyRating(agencyRating)
+    {}
+
+    // Urls with the same host get the same id
+    uint32_t Add(const std::string& url);
+
+    const std::string& GetHost(uint32_t id) const { return Hosts.at(id); }
+    double GetScore(uint32_t id) const { return Scores.at(id); }
+    size_t Size() const { return Hosts.size(); }
+
+private:
+    const TAgencyRating& AgencyRating;
+    std::unordered_map<std::string, uint32_t> Ids;
+    std::vector<std::string> Hosts;
+    std::vector<double> Scores;
+};
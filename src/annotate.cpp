@@ -1,90 +1,586 @@
 #include "annotate.h"
 #include "detect.h"
+#include "duplicates.h"
+#include "json_reader.h"
+#include "mapped_file.h"
+#include "tar_reader.h"
 #include "thread_pool.h"
 #include "timer.h"
 #include "util.h"
 
-void Annotate(
-    const std::vector<std::string>& fileNames,
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace {
+
+// Bound on the documents that are requested but not saved yet
+const size_t DOCUMENTS_IN_FLIGHT_PER_THREAD = 16;
+// JSON Lines files are split into this many chunks per thread to balance the load
+const size_t JSON_LINES_CHUNKS_PER_THREAD = 4;
+// Ordinals of documents are the input index shifted by this, plus the position inside the file
+const size_t ORDINAL_INDEX_SHIFT = 40;
+
+// Reports the input files, see ReadFileNames. Data is passed when the input
+// is already in memory, otherwise it is null and the file is read by path.
+using TInputCallback = std::function<void(size_t index, const std::string& path, TFileDataPtr data)>;
+using TInputReader = std::function<void(TThreadPool&, const TInputCallback&)>;
+
+using TDocumentFuture = std::future<boost::optional<TDocument>>;
+
+// Documents in flight, saved strictly in the input order. Once more than maxInFlight
+// of them are not saved yet, the oldest ones are waited for, which holds the input back.
+class TInFlightDocuments {
+public:
+    using TSaveCallback = std::function<void(boost::optional<TDocument>&&)>;
+
+    TInFlightDocuments(size_t maxInFlight, TSaveCallback save)
+        : MaxInFlight(maxInFlight)
+        , Save(std::move(save))
+    {}
+
+    // Indices may come out of order, a document is saved once all the previous ones are
+    void Put(size_t index, TDocumentFuture future) {
+        if (index >= Futures.size()) {
+            Futures.resize(index + 1);
+        }
+        Futures[index] = std::move(future);
+        PutCount++;
+        SaveOldest(MaxInFlight);
+    }
+
+    void Add(TDocumentFuture future) {
+        Put(Futures.size(), std::move(future));
+    }
+
+    void SaveAll() {
+        SaveOldest(0);
+    }
+
+    // Queued tasks refer to the locals of the caller, so they are waited for on errors
+    void WaitAll() {
+        for (TDocumentFuture& future : Futures) {
+            if (future.valid()) {
+                future.wait();
+            }
+        }
+    }
+
+    size_t Size() const {
+        return PutCount;
+    }
+
+private:
+    void SaveOldest(size_t maxInFlight) {
+        while (PutCount - SavedCount > maxInFlight && Futures[SavedCount].valid()) {
+            Save(Futures[SavedCount].get());
+            SavedCount++;
+        }
+    }
+
+private:
+    const size_t MaxInFlight;
+    const TSaveCallback Save;
+    std::vector<TDocumentFuture> Futures;
+    size_t PutCount = 0;
+    size_t SavedCount = 0;
+};
+
+// Thread time of the stages of one document in microseconds
+struct TStageTimes {
+    uint64_t Parsing = 0;
+    uint64_t Tokenization = 0;
+    uint64_t Classification = 0;
+
+    uint64_t Total() const {
+        return Parsing + Tokenization + Classification;
+    }
+};
+
+// The documents with the largest total stage time, kept for the report at the end
+class TSlowestDocuments {
+public:
+    struct TEntry {
+        std::string FileName;
+        TStageTimes Times;
+    };
+
+    explicit TSlowestDocuments(size_t maxCount)
+        : MaxCount(maxCount)
+    {}
+
+    void Add(const std::string& fileName, const TStageTimes& times) {
+        // Once the heap is full, most documents are faster than all of it and skip the lock
+        if (MaxCount == 0 || times.Total() <= MinTotal.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(Mutex);
+        if (Entries.size() == MaxCount) {
+            if (times.Total() <= Entries.front().Times.Total()) {
+                return;
+            }
+            std::pop_heap(Entries.begin(), Entries.end(), IsSlower);
+            Entries.pop_back();
+        }
+        Entries.push_back({fileName, times});
+        std::push_heap(Entries.begin(), Entries.end(), IsSlower);
+        if (Entries.size() == MaxCount) {
+            MinTotal = Entries.front().Times.Total();
+        }
+    }
+
+    // The slowest first
+    std::vector<TEntry> Get() const {
+        std::lock_guard<std::mutex> lock(Mutex);
+        std::vector<TEntry> entries = Entries;
+        std::sort(entries.begin(), entries.end(), IsSlower);
+        return entries;
+    }
+
+private:
+    // Makes a min-heap, its front is the fastest of the kept documents
+    static bool IsSlower(const TEntry& left, const TEntry& right) {
+        return left.Times.Total() > right.Times.Total();
+    }
+
+private:
+    const size_t MaxCount;
+    mutable std::mutex Mutex;
+    std::vector<TEntry> Entries;
+    std::atomic<uint64_t> MinTotal{0};
+};
+
+void AnnotateFiles(
+    const TInputReader& readInput,
     const TModelStorage& models,
     const std::set<std::string>& languages,
     std::vector<TDocument>& docs,
-    size_t minTextLength,
-    bool parseLinks,
-    bool fromJson)
+    const TAnnotateOptions& options)
 {
-    LOG_DEBUG("Annotating " << fileNames.size() << " files...");
+    LOG_DEBUG("Annotating files...");
     TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> timer;
     docs.clear();
-    docs.reserve(fileNames.size() / 2);
-    TThreadPool threadPool;
-    auto parseHtml = [&](const std::string& path) -> boost::optional<TDocument> {
+    // Every task is waited for before returning, so a shared pool can outlive the call
+    std::unique_ptr<TThreadPool> ownThreadPool;
+    if (!options.ThreadPool) {
+        ownThreadPool.reset(new TThreadPool());
+    }
+    TThreadPool& threadPool = options.ThreadPool ? *options.ThreadPool : *ownThreadPool;
+    const TLanguageDetector languageDetector(models.Get("lang_detect_model"), options.DetectScripts);
+    // Labels of the classifiers are converted once, not for every document
+    std::unordered_map<std::string, std::unique_ptr<TCategoryDetector>> categoryDetectors;
+    for (const std::string& language : languages) {
+        categoryDetectors.emplace(
+            language,
+            std::unique_ptr<TCategoryDetector>(new TCategoryDetector(models.Get(language + "_cat_detect_model"))));
+    }
+    auto isRequestedLanguage = [&](const TDocument& doc) {
+        return doc.Language && languages.find(doc.Language.get()) != languages.end();
+    };
+    auto detectLanguage = [&](TDocument& doc) {
+        doc.Language = languageDetector.Detect(doc);
+        return isRequestedLanguage(doc);
+    };
+    // Language is detected from the head and the beginning of the text,
+    // bodies of pages in other languages are not parsed at all
+    std::atomic<uint64_t> skippedBytes(0);
+    // Thread time of the stages
+    std::atomic<uint64_t> parsingTime(0);
+    std::atomic<uint64_t> tokenizationTime(0);
+    std::atomic<uint64_t> classificationTime(0);
+    // Pages over the limits, in total and by the limit
+    std::atomic<uint64_t> truncatedDocuments(0);
+    std::atomic<uint64_t> truncatedByLimit[DL_COUNT] = {};
+    TSlowestDocuments slowestDocuments(options.SlowestCount);
+    // Rejected pages by the reason, a noisy crawl has lots of them, so they are not exceptions
+    std::atomic<uint64_t> parseFailures[PS_COUNT] = {};
+    // Without data the file is read by the parsing task itself
+    auto parseHtml = [&](const std::string& path, TFileDataPtr data, TStageTimes& times) -> boost::optional<TDocument> {
+        TTimer<std::chrono::high_resolution_clock, std::chrono::microseconds> parsingTimer;
         TDocument doc;
-        try {
-            doc.FromHtml(path.c_str(), parseLinks);
-        } catch (...) {
-            LOG_DEBUG("Bad html: " << path);
+        size_t skipped = 0;
+        EParseStatus status = PS_NO_FILE;
+        if (!data) {
+            status = doc.TryFromHtml(
+                path.c_str(),
+                skipped,
+                options.ParseLinks,
+                /* shrinkText = */ false,
+                /* maxWords = */ 200,
+                options.HtmlParser,
+                detectLanguage,
+                LANGUAGE_DETECTION_TEXT_LENGTH,
+                options.Limits);
+        } else if (data->IsRead()) {
+            doc.FileName = path;
+            status = doc.TryFromHtmlBuffer(
+                data->Data(),
+                data->Size(),
+                skipped,
+                options.ParseLinks,
+                /* shrinkText = */ false,
+                /* maxWords = */ 200,
+                detectLanguage,
+                LANGUAGE_DETECTION_TEXT_LENGTH,
+                options.Limits);
+        }
+        times.Parsing = parsingTimer.Elapsed();
+        parsingTime += times.Parsing;
+        skippedBytes += skipped;
+        if (status != PS_OK) {
+            parseFailures[status]++;
+            LOG_DEBUG("Bad html: " << path << ", " << GetParseError(status));
+            return boost::none;
+        }
+        if (doc.TruncatedLimits != 0) {
+            truncatedDocuments++;
+            for (size_t limit = 0; limit < DL_COUNT; limit++) {
+                if (doc.TruncatedLimits & (1u << limit)) {
+                    truncatedByLimit[limit]++;
+                }
+            }
+        }
+        if (!isRequestedLanguage(doc)) {
             return boost::none;
         }
-        if (doc.Text.length() < minTextLength) {
+        if (doc.Text.length() < options.MinTextLength) {
             return boost::none;
         }
         return doc;
     };
-    std::vector<std::future<boost::optional<TDocument>>> futures;
-    if (!fromJson) {
-        futures.reserve(fileNames.size());
-        for (const std::string& path: fileNames) {
-            futures.push_back(threadPool.enqueue(parseHtml, path));
+    onmt::Tokenizer tokenizer(onmt::Tokenizer::Mode::Conservative, onmt::Tokenizer::Flags::CaseFeature);
+    // Copies of a document are found right after parsing, see saveDocument for the rest
+    TDuplicateFilter duplicateFilter;
+    std::atomic<uint64_t> skippedDuplicates(0);
+    // Texts the consumers did not need to the end
+    std::atomic<uint64_t> cutTokenizations(0);
+    // A rejected document keeps only what is needed to reject its later copies
+    auto rejectDocument = [](TDocument& doc) {
+        TDocument rejected;
+        rejected.FileName = std::move(doc.FileName);
+        rejected.UrlHash = doc.UrlHash;
+        rejected.TextHash = doc.TextHash;
+        return rejected;
+    };
+    auto annotateDocument = [&](TDocument doc, uint64_t ordinal, TStageTimes& times) -> boost::optional<TDocument> {
+        if (options.Deduplicate && !duplicateFilter.Claim(doc, ordinal)) {
+            skippedDuplicates++;
+            return rejectDocument(doc);
         }
-        for (auto& futureDoc : futures) {
-            boost::optional<TDocument> doc = futureDoc.get();
-            if (!doc) {
-                continue;
-            }
-            docs.push_back(std::move(doc.get()));
-        }
-        futures.clear();
-    } else {
-        for (const std::string& path: fileNames) {
-            std::ifstream fileStream(path);
-            nlohmann::json json;
-            fileStream >> json;
-            for (const nlohmann::json& obj : json) {
-                TDocument doc(obj);
-                docs.push_back(std::move(doc));
+        if (options.FromJson && !detectLanguage(doc)) {
+            return rejectDocument(doc);
+        }
+        TTimer<std::chrono::high_resolution_clock, std::chrono::microseconds> stageTimer;
+        const fasttext::FastText& categoryModel = models.Get(*doc.Language + "_cat_detect_model");
+        // Only the clustering needs the vector model ids
+        const fasttext::FastText* vectorModel = nullptr;
+        if (options.Level == AL_FULL) {
+            vectorModel = &models.Get(*doc.Language + "_vector_model");
+        }
+        const auto languageLimits = options.TokenLimits.find(*doc.Language);
+        const bool isTokenizedInFull = doc.PreprocessTextFields(
+            tokenizer,
+            categoryModel,
+            vectorModel,
+            languageLimits != options.TokenLimits.end() ? languageLimits->second : TTokenLimits());
+        if (!isTokenizedInFull) {
+            cutTokenizations++;
+        }
+        times.Tokenization = stageTimer.Elapsed();
+        tokenizationTime += times.Tokenization;
+        stageTimer.Reset();
+        doc.Category = categoryDetectors.at(*doc.Language)->Detect(doc);
+        times.Classification = stageTimer.Elapsed();
+        classificationTime += times.Classification;
+        doc.CategoryTokens = TTokenIds();
+        if (!doc.IsNews()) {
+            return rejectDocument(doc);
+        }
+        if (options.Level < AL_TEXT) {
+            // Texts are the largest part of the document, the output never shows them
+            std::string().swap(doc.Text);
+            std::string().swap(doc.Description);
+            std::vector<std::string>().swap(doc.OutLinks);
+        }
+        return doc;
+    };
+    auto isSaved = [](const boost::optional<TDocument>& doc) {
+        if (!doc || !doc->Language) {
+            return false;
+        }
+        return doc->Category != NC_UNDEFINED && doc->Category != NC_NOT_NEWS;
+    };
+    // Copies share the fate of their first document in the output order, so the result
+    // does not depend on which of them the filter saw first
+    TDuplicateFolder duplicateFolder;
+    auto saveDocument = [&](boost::optional<TDocument>&& doc) {
+        if (!doc) {
+            return;
+        }
+        // The copy and the copies folded into it are appended to the file names of the document
+        const size_t copiesCount = 1 + doc->DuplicateFileNames.size();
+        size_t position = TDuplicateFolder::NOT_SAVED;
+        if (duplicateFolder.Fold(doc.get(), docs, &position)) {
+            if (options.OnDuplicate && position != TDuplicateFolder::NOT_SAVED) {
+                const TDocument& original = docs[position];
+                const std::vector<std::string>& fileNames = original.DuplicateFileNames;
+                for (size_t i = fileNames.size() - copiesCount; i < fileNames.size(); i++) {
+                    TDocument copy;
+                    copy.FileName = fileNames[i];
+                    copy.DuplicateOf = original.FileName;
+                    options.OnDuplicate(copy);
+                }
             }
+            return;
         }
-    }
+        if (!isSaved(doc)) {
+            duplicateFolder.Add(doc.get(), TDuplicateFolder::NOT_SAVED);
+            return;
+        }
+        docs.push_back(std::move(doc.get()));
+        duplicateFolder.Add(docs.back(), docs.size() - 1);
+        if (options.OnDocument) {
+            options.OnDocument(docs.back());
+        }
+    };
 
-    const auto& langDetectModel = *models.at("lang_detect_model");
-    onmt::Tokenizer tokenizer(onmt::Tokenizer::Mode::Conservative, onmt::Tokenizer::Flags::CaseFeature);
-    auto annotateDocument = [&](TDocument doc) -> boost::optional<TDocument> {
-        doc.Language = DetectLanguage(langDetectModel, doc);
-        if (!doc.Language || languages.find(doc.Language.get()) == languages.end()) {
-            return boost::none;
+    // Once a file is read, its stages run back to back in one pool task: the page is parsed
+    // up to the language detection, then to the end, then it is tokenized and classified.
+    // The only queues are the bounded ones before and after: the reader budget and inFlight.
+    auto processHtml = [&](const std::string& path, TFileDataPtr data, uint64_t ordinal) -> boost::optional<TDocument> {
+        TStageTimes times;
+        boost::optional<TDocument> doc = parseHtml(path, std::move(data), times);
+        if (doc) {
+            doc = annotateDocument(std::move(doc.get()), ordinal, times);
         }
-        doc.PreprocessTextFields(tokenizer);
-        doc.Category = DetectCategory(*models.at(*doc.Language + "_cat_detect_model"), doc);
+        slowestDocuments.Add(path, times);
         return doc;
     };
-    for (const TDocument& doc: docs) {
-        futures.push_back(threadPool.enqueue(annotateDocument, std::move(doc)));
-    }
-    docs.clear();
+    // Fulfils the promise on the pool. The buffer is released as soon as the page is parsed,
+    // not when the task is destroyed.
+    using TDocumentPromise = std::shared_ptr<std::promise<boost::optional<TDocument>>>;
+    auto enqueueHtml = [&](TDocumentPromise promise, const std::string& path, TFileDataPtr data, uint64_t ordinal) {
+        threadPool.enqueue([&processHtml, promise, path, data, ordinal]() mutable {
+            try {
+                promise->set_value(processHtml(path, std::move(data), ordinal));
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+    };
+    auto annotateJson = [&](const nlohmann::json& json, uint64_t ordinal) {
+        TStageTimes times;
+        TTimer<std::chrono::high_resolution_clock, std::chrono::microseconds> parsingTimer;
+        TDocument doc(json);
+        times.Parsing = parsingTimer.Elapsed();
+        if (!doc.DuplicateOf.empty()) {
+            // Only the file name is left of the copy, it is folded into its document as it is
+            return boost::optional<TDocument>(std::move(doc));
+        }
+        boost::optional<TDocument> annotated = annotateDocument(std::move(doc), ordinal, times);
+        slowestDocuments.Add(annotated ? annotated->FileName : std::string(), times);
+        return annotated;
+    };
+    auto buildDocument = [&annotateJson](const std::shared_ptr<nlohmann::json>& json, uint64_t ordinal) {
+        return annotateJson(*json, ordinal);
+    };
+    // JSON Lines are split into newline aligned chunks that are parsed in parallel
+    auto readJsonLines = [&](size_t index, const std::string& path) {
+        TMappedFile file;
+        if (!file.Open(path.c_str())) {
+            throw std::runtime_error("Can't read JSON Lines file: " + path);
+        }
+        const std::vector<std::pair<size_t, size_t>> chunks = SplitByLines(
+            file.Data(),
+            file.Size(),
+            JSON_LINES_CHUNKS_PER_THREAD * std::thread::hardware_concurrency());
+        std::vector<std::future<std::vector<boost::optional<TDocument>>>> chunkFutures;
+        for (const auto& chunk : chunks) {
+            chunkFutures.push_back(threadPool.enqueue([&](const char* begin, const char* end) {
+                std::vector<boost::optional<TDocument>> chunkDocs;
+                // A line is at least a byte long, so the offset of the chunk plus the line number is unique
+                const uint64_t firstOrdinal = (static_cast<uint64_t>(index) << ORDINAL_INDEX_SHIFT) + (begin - file.Data());
+                ReadJsonLines(begin, end, [&](nlohmann::json&& json) {
+                    boost::optional<TDocument> doc = annotateJson(json, firstOrdinal + chunkDocs.size());
+                    chunkDocs.push_back(std::move(doc));
+                });
+                return chunkDocs;
+            }, file.Data() + chunk.first, file.Data() + chunk.second));
+        }
+        for (auto& chunkFuture : chunkFutures) {
+            chunkFuture.wait();
+        }
+        for (auto& chunkFuture : chunkFutures) {
+            for (boost::optional<TDocument>& doc : chunkFuture.get()) {
+                saveDocument(std::move(doc));
+            }
+        }
+    };
 
-    for (auto& futureDoc : futures) {
-        boost::optional<TDocument> doc = futureDoc.get();
-        if (!doc
-            || !doc->Language
-            || doc->Category == NC_UNDEFINED
-            || doc->Category == NC_NOT_NEWS)
-        {
-            continue;
+    TInFlightDocuments inFlight(DOCUMENTS_IN_FLIGHT_PER_THREAD * std::thread::hardware_concurrency(), saveDocument);
+    // Files are read by a dedicated stage, tinyxml2 can only load them by itself
+    std::unique_ptr<TFileReader> reader;
+    if (!options.FromJson && options.ReadMethod != RM_MMAP && options.HtmlParser == HP_STREAMING) {
+        reader.reset(new TFileReader(
+            options.ReadMethod,
+            options.ReadBudget,
+            /* queueDepth = */ 64,
+            GetMaxReadBytes(options.Limits)));
+    }
+    try {
+        if (!options.FromJson) {
+            // Files are processed while the rest of them is still being listed
+            readInput(threadPool, [&](size_t index, const std::string& path, TFileDataPtr data) {
+                auto promise = std::make_shared<std::promise<boost::optional<TDocument>>>();
+                TDocumentFuture future = promise->get_future();
+                const uint64_t ordinal = static_cast<uint64_t>(index) << ORDINAL_INDEX_SHIFT;
+                if (data || !reader) {
+                    enqueueHtml(promise, path, std::move(data), ordinal);
+                } else {
+                    reader->Read(path, [&enqueueHtml, promise, ordinal](TFileDataPtr data) {
+                        enqueueHtml(promise, data->GetFileName(), std::move(data), ordinal);
+                    });
+                }
+                // Waits for the oldest documents, so the task has to be started before
+                inFlight.Put(index, std::move(future));
+            });
+        } else {
+            // Documents are built and annotated while the rest of the file is parsed
+            readInput(threadPool, [&](size_t index, const std::string& path, TFileDataPtr) {
+                if (IsJsonLines(path)) {
+                    inFlight.SaveAll();
+                    readJsonLines(index, path);
+                    return;
+                }
+                std::ifstream fileStream(path);
+                uint64_t ordinal = static_cast<uint64_t>(index) << ORDINAL_INDEX_SHIFT;
+                ReadJsonArray(fileStream, [&](nlohmann::json&& json) {
+                    auto element = std::make_shared<nlohmann::json>(std::move(json));
+                    inFlight.Add(threadPool.enqueue(buildDocument, std::move(element), ordinal++));
+                });
+            });
+        }
+        inFlight.SaveAll();
+    } catch (...) {
+        inFlight.WaitAll();
+        throw;
+    }
+    LOG_STATS(options.Stats, "Files count: " << inFlight.Size());
+    if (reader) {
+        reader->Finish();
+        LOG_STATS(options.Stats, "Reading: " << reader->GetBytesRead() / 1048576.0 << " MB in "
+            << reader->GetReadTimeMs() << " ms, "
+            << (reader->GetReadTimeMs() > 0.0 ? reader->GetBytesRead() / 1048.576 / reader->GetReadTimeMs() : 0.0)
+            << " MB/s with " << (reader->GetMethod() == RM_IO_URING ? "io_uring" : "pread")
+            << (reader->GetFallbackReason().empty() ? "" : ", io_uring failed: ") << reader->GetFallbackReason());
+    }
+    if (!options.FromJson) {
+        LOG_STATS(options.Stats, "Parsing: " << skippedBytes << " bytes of unwanted languages skipped");
+        LOG_STATS(options.Stats, "Limits: " << truncatedDocuments << " documents truncated, "
+            << truncatedByLimit[DL_BYTES] << " by bytes, "
+            << truncatedByLimit[DL_PARAGRAPHS] << " by paragraphs, "
+            << truncatedByLimit[DL_TEXT_LENGTH] << " by text length, "
+            << truncatedByLimit[DL_OUT_LINKS] << " by out links");
+        uint64_t failuresCount = 0;
+        for (size_t status = PS_OK + 1; status < PS_COUNT; status++) {
+            failuresCount += parseFailures[status];
+        }
+        LOG_STATS(options.Stats, "Parsing failures: " << failuresCount);
+        for (size_t status = PS_OK + 1; status < PS_COUNT; status++) {
+            if (parseFailures[status] != 0) {
+                LOG_STATS(options.Stats, "    " << GetParseError(static_cast<EParseStatus>(status)) << ": " << parseFailures[status]);
+            }
+        }
+    }
+    LOG_STATS(options.Stats, "Duplicates: " << skippedDuplicates << " copies skipped before annotation, "
+        << duplicateFolder.GetFoldedCount() << " folded into saved documents, "
+        << duplicateFolder.GetDroppedCount() << " dropped with their first copy");
+    LOG_STATS(options.Stats, "Language detection: " << languageDetector.GetRussianByScriptsCount() << " ru and "
+        << languageDetector.GetEnglishByScriptsCount() << " en documents by scripts, "
+        << languageDetector.GetByModelCount() << " by the model");
+    LOG_STATS(options.Stats, "Stages: parsing " << parsingTime / 1000 << " ms, tokenization " << tokenizationTime / 1000
+        << " ms, classification " << classificationTime / 1000 << " ms of thread time");
+    LOG_STATS(options.Stats, "Tokenization: " << cutTokenizations << " texts stopped at the token limits");
+    LOG_STATS(options.Stats, "Models: " << models.GetWaitTimeMs() << " ms of thread time waiting for them to load");
+    if (options.SlowestCount != 0) {
+        std::cerr << "Slowest documents, thread time in us:" << std::endl;
+        for (const TSlowestDocuments::TEntry& entry : slowestDocuments.Get()) {
+            std::cerr << entry.FileName << "\t" << entry.Times.Total()
+                << "\tparsing " << entry.Times.Parsing
+                << ", tokenization " << entry.Times.Tokenization
+                << ", classification " << entry.Times.Classification << std::endl;
         }
-        docs.push_back(std::move(doc.get()));
     }
     docs.shrink_to_fit();
     LOG_DEBUG("Annotation: " << docs.size() << " documents saved, " << timer.Elapsed() << " ms");
 }
 
+} // namespace
+
+void Annotate(
+    const std::vector<std::string>& fileNames,
+    const TModelStorage& models,
+    const std::set<std::string>& languages,
+    std::vector<TDocument>& docs,
+    const TAnnotateOptions& options)
+{
+    auto readInput = [&fileNames](TThreadPool&, const TInputCallback& onInput) {
+        for (size_t i = 0; i < fileNames.size(); i++) {
+            onInput(i, fileNames[i], TFileDataPtr());
+        }
+    };
+    AnnotateFiles(readInput, models, languages, docs, options);
+}
+
+void AnnotateDirectory(
+    const std::string& directory,
+    const TModelStorage& models,
+    const std::set<std::string>& languages,
+    std::vector<TDocument>& docs,
+    int nDocs,
+    bool sortByInode,
+    const TAnnotateOptions& options)
+{
+    auto readInput = [&](TThreadPool& threadPool, const TInputCallback& onInput) {
+        ReadFileNames(directory, threadPool, [&onInput](size_t index, const std::string& path) {
+            onInput(index, path, TFileDataPtr());
+        }, nDocs, sortByInode);
+    };
+    TAnnotateOptions directoryOptions = options;
+    directoryOptions.FromJson = false;
+    AnnotateFiles(readInput, models, languages, docs, directoryOptions);
+}
+
+void AnnotateArchive(
+    const std::string& archiveName,
+    const TModelStorage& models,
+    const std::set<std::string>& languages,
+    std::vector<TDocument>& docs,
+    int nDocs,
+    const TAnnotateOptions& options)
+{
+    auto readInput = [&](TThreadPool&, const TInputCallback& onInput) {
+        TTarReader reader(archiveName, options.ReadBudget);
+        size_t index = 0;
+        while (nDocs <= 0 || index < static_cast<size_t>(nDocs)) {
+            TFileDataPtr data = reader.Next();
+            if (!data) {
+                break;
+            }
+            if (!boost::algorithm::ends_with(data->GetFileName(), ".html")) {
+                continue;
+            }
+            const std::string path = data->GetFileName();
+            onInput(index++, path, std::move(data));
+        }
+    };
+    // The files are already in memory, the streaming parser reads them as they are
+    TAnnotateOptions archiveOptions = options;
+    archiveOptions.FromJson = false;
+    archiveOptions.HtmlParser = HP_STREAMING;
+    archiveOptions.ReadMethod = RM_MMAP;
+    AnnotateFiles(readInput, models, languages, docs, archiveOptions);
+}
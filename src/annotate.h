@@ -1,21 +1,88 @@
 #pragma once
 
 #include "document.h"
+#include "file_reader.h"
+#include "model_storage.h"
 
+#include <functional>
+#include <iosfwd>
 #include <memory>
+#include <string>
 #include <set>
 #include <unordered_map>
 #include <vector>
 
 #include <fasttext.h>
 
-using TModelStorage = std::unordered_map<std::string, std::unique_ptr<fasttext::FastText>>;
+class TThreadPool;
+
+// Token limits of the documents in each language, languages without them are tokenized in full
+using TTokenLimitsByLanguage = std::unordered_map<std::string, TTokenLimits>;
+
+// Stages and document fields the output mode needs, the rest is skipped
+enum EAnnotationLevel {
+    // Categories for the not-news filter, not news are dropped. Texts and tokens are dropped after the classification.
+    AL_CATEGORY = 0,
+    // Texts for the json output, without the vector model ids
+    AL_TEXT = 1,
+    // Everything the clustering needs
+    AL_FULL = 2
+};
+
+// Called on the calling thread for every saved document in the output order, as soon as it is annotated
+using TDocumentCallback = std::function<void(const TDocument&)>;
+
+// How the documents are read, parsed and annotated, the same for every kind of input
+struct TAnnotateOptions {
+    size_t MinTextLength = 20;
+    bool ParseLinks = false;
+    // The input is a JSON file of documents, directories and archives are always HTML
+    bool FromJson = false;
+    EHtmlParser HtmlParser = HP_STREAMING;
+    EReadMethod ReadMethod = RM_IO_URING;
+    size_t ReadBudget = 256 << 20;
+    TDocumentCallback OnDocument;
+    // Called after OnDocument for every copy folded into a document it already got,
+    // with a copy that has only TDocument::FileName and TDocument::DuplicateOf
+    TDocumentCallback OnDuplicate;
+    EAnnotationLevel Level = AL_FULL;
+    bool DetectScripts = true;
+    // Copies are annotated once and folded into their first document, see TDuplicateFilter
+    bool Deduplicate = true;
+    // Pages over the limits are truncated while parsing and counted
+    TDocumentLimits Limits;
+    // That many documents with the largest thread time of their stages are reported to stderr
+    size_t SlowestCount = 0;
+    // Counters of the run are written here, nothing without it
+    std::ostream* Stats = nullptr;
+    TTokenLimitsByLanguage TokenLimits;
+    // Without it the documents are processed on a pool of their own, concurrent calls can share one instead
+    TThreadPool* ThreadPool = nullptr;
+};
 
 void Annotate(
     const std::vector<std::string>& fileNames,
     const TModelStorage& models,
     const std::set<std::string>& languages,
     std::vector<TDocument>& docs,
-    size_t minTextLength = 20,
-    bool parseLinks = false,
-    bool fromJson = false);
+    const TAnnotateOptions& options = TAnnotateOptions());
+
+// Annotate for all html files in the directory, they are parsed while the tree is still listed
+void AnnotateDirectory(
+    const std::string& directory,
+    const TModelStorage& models,
+    const std::set<std::string>& languages,
+    std::vector<TDocument>& docs,
+    int nDocs = -1,
+    bool sortByInode = false,
+    const TAnnotateOptions& options = TAnnotateOptions());
+
+// Annotate for html files in a .tar or .tar.gz archive, they are parsed in memory
+// with the streaming parser and named by their paths inside the archive
+void AnnotateArchive(
+    const std::string& archiveName,
+    const TModelStorage& models,
+    const std::set<std::string>& languages,
+    std::vector<TDocument>& docs,
+    int nDocs = -1,
+    const TAnnotateOptions& options = TAnnotateOptions());
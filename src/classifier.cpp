@@ -0,0 +1,113 @@
+#include "classifier.h"
+
+#include <cmath>
+
+#include <fasttext.h>
+
+namespace {
+
+const size_t FT_PREFIX_LENGTH = 9; // __label__
+
+}
+
+TFastTextClassifier::TFastTextClassifier(fasttext::FastText& model)
+    : Model(&model)
+    , Dimension(model.getDimension())
+{
+    const std::shared_ptr<const fasttext::Dictionary> dictionary = model.getDictionary();
+    for (int32_t i = 0; i < dictionary->nlabels(); i++) {
+        Labels.push_back(dictionary->getLabel(i).substr(FT_PREFIX_LENGTH));
+    }
+    const fasttext::Args args = model.getArgs();
+    IsNative = args.model == fasttext::model_name::sup
+        && args.loss == fasttext::loss_name::softmax
+        && !(model.isQuant() && args.qout);
+    if (!IsNative) {
+        return;
+    }
+    if (!model.isQuant()) {
+        ModelInputMatrix = model.getInputMatrix();
+        InputRows = ModelInputMatrix->data();
+    }
+    const std::shared_ptr<const fasttext::DenseMatrix> outputMatrix = model.getOutputMatrix();
+    OutputMatrix = Eigen::Map<const TMatrix>(outputMatrix->data(), outputMatrix->rows(), outputMatrix->cols());
+}
+
+TFastTextClassifier::TFastTextClassifier(TMatrix inputMatrix, TMatrix outputMatrix, std::vector<std::string> labels)
+    : IsNative(true)
+    , InputMatrix(std::move(inputMatrix))
+    , InputRows(InputMatrix.data())
+    , Dimension(InputMatrix.cols())
+    , OutputMatrix(std::move(outputMatrix))
+    , Labels(std::move(labels))
+{
+}
+
+std::vector<TFastTextPrediction> TFastTextClassifier::Predict(
+    const std::vector<const std::vector<int32_t>*>& lines,
+    float threshold) const
+{
+    std::vector<TFastTextPrediction> predictions(lines.size());
+    if (!IsNative) {
+        fasttext::Predictions linePredictions;
+        for (size_t i = 0; i < lines.size(); i++) {
+            Model->predict(1, *lines[i], linePredictions, threshold);
+            if (!linePredictions.empty()) {
+                predictions[i].Label = linePredictions[0].second;
+                predictions[i].Probability = std::exp(linePredictions[0].first);
+            }
+        }
+        return predictions;
+    }
+
+    // Model::computeHidden: the average of the input rows
+    TMatrix hidden = TMatrix::Zero(lines.size(), Dimension);
+    std::unique_ptr<fasttext::Vector> decodedRow;
+    if (!InputRows) {
+        decodedRow.reset(new fasttext::Vector(Dimension));
+    }
+    for (size_t i = 0; i < lines.size(); i++) {
+        const std::vector<int32_t>& line = *lines[i];
+        if (line.empty()) {
+            continue;
+        }
+        auto hiddenRow = hidden.row(i);
+        for (int32_t id : line) {
+            if (InputRows) {
+                hiddenRow += Eigen::Map<const Eigen::RowVectorXf>(InputRows + id * Dimension, Dimension);
+            } else {
+                Model->getInputVector(*decodedRow, id);
+                hiddenRow += Eigen::Map<const Eigen::RowVectorXf>(decodedRow->data(), Dimension);
+            }
+        }
+        hiddenRow *= static_cast<float>(1.0 / line.size());
+    }
+
+    // Row by row, so a document gets the same numbers in any batch
+    Eigen::VectorXf outputRow(OutputMatrix.rows());
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (lines[i]->empty()) {
+            continue;
+        }
+        outputRow.noalias() = OutputMatrix * hidden.row(i).transpose();
+        // Only the softmax of the best label is needed. On ties fastText keeps the last one.
+        Eigen::Index best = 0;
+        for (Eigen::Index j = 1; j < outputRow.size(); j++) {
+            if (outputRow[j] >= outputRow[best]) {
+                best = j;
+            }
+        }
+        const float probability = 1.0f / (outputRow.array() - outputRow[best]).exp().sum();
+        if (probability < threshold) {
+            continue;
+        }
+        predictions[i].Label = best;
+        // predictLine reports exp(std_log(p)) where std_log(p) = log(p + 1e-5)
+        predictions[i].Probability = std::exp(std::log(probability + 1e-5f));
+    }
+    return predictions;
+}
+
+TFastTextPrediction TFastTextClassifier::Predict(const std::vector<int32_t>& line, float threshold) const {
+    return Predict(std::vector<const std::vector<int32_t>*>(1, &line), threshold).front();
+}
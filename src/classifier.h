@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace fasttext {
+    class FastText;
+    class DenseMatrix;
+}
+
+struct TFastTextPrediction {
+    // Index of the label, -1 if no label reaches the threshold
+    int32_t Label = -1;
+    float Probability = 0.0f;
+};
+
+// Inference of a fastText classifier on input ids resolved beforehand, see TTokenIds.
+// Softmax models are computed here: input rows are averaged with Eigen, buffers are shared
+// by the whole batch and only the best label is searched for, nothing is sorted.
+// Other losses and quantized output layers go through FastText::predict.
+class TFastTextClassifier {
+public:
+    using TMatrix = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+    explicit TFastTextClassifier(fasttext::FastText& model);
+    // A softmax model given by its layers, labels are in the order of the output rows
+    TFastTextClassifier(TMatrix inputMatrix, TMatrix outputMatrix, std::vector<std::string> labels);
+    TFastTextClassifier(const TFastTextClassifier&) = delete;
+    TFastTextClassifier& operator=(const TFastTextClassifier&) = delete;
+
+    // Best label of every line with the probability predictLine reports for it
+    std::vector<TFastTextPrediction> Predict(const std::vector<const std::vector<int32_t>*>& lines, float threshold) const;
+    TFastTextPrediction Predict(const std::vector<int32_t>& line, float threshold) const;
+
+    // Labels without the __label__ prefix
+    const std::vector<std::string>& GetLabels() const { return Labels; }
+
+private:
+    fasttext::FastText* Model = nullptr;
+    bool IsNative = false;
+    // Dense input rows, shared with the model or owned. Rows of quantized models are decoded by the model.
+    std::shared_ptr<const fasttext::DenseMatrix> ModelInputMatrix;
+    TMatrix InputMatrix;
+    const float* InputRows = nullptr;
+    int64_t Dimension = 0;
+    // Labels x dimension
+    TMatrix OutputMatrix;
+    std::vector<std::string> Labels;
+};
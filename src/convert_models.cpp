@@ -0,0 +1,114 @@
+#include "embedder.h"
+#include "mapped_matrix.h"
+#include "util.h"
+
+#include <boost/program_options.hpp>
+#include <fasttext.h>
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace po = boost::program_options;
+
+namespace {
+
+// Same file as FastText::saveModel without the weights: loadModel reads it as a model
+// with empty input and output matrices, only the dictionary and the args are left
+void SaveDictionary(const fasttext::FastText& model, const std::string& fileName) {
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Can not open " + fileName);
+    }
+    const int32_t magic = FASTTEXT_FILEFORMAT_MAGIC_INT32;
+    const int32_t version = FASTTEXT_VERSION;
+    out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    fasttext::Args args = model.getArgs();
+    args.save(out);
+    model.getDictionary()->save(out);
+    const fasttext::DenseMatrix emptyMatrix(0, args.dim);
+    const bool isQuant = false;
+    out.write(reinterpret_cast<const char*>(&isQuant), sizeof(isQuant));
+    emptyMatrix.save(out);
+    out.write(reinterpret_cast<const char*>(&isQuant), sizeof(isQuant));
+    emptyMatrix.save(out);
+    if (!out.flush()) {
+        throw std::runtime_error("Can not write " + fileName);
+    }
+}
+
+// Splits a fastText vector model into its dictionary and a mappable input matrix
+void ConvertVectorModel(const po::variables_map& vm) {
+    const std::string input = vm["input"].as<std::string>();
+    fasttext::FastText model;
+    model.loadModel(input);
+    if (model.isQuant()) {
+        throw std::runtime_error("Quantized models can not be mapped: " + input);
+    }
+    const std::shared_ptr<const fasttext::DenseMatrix> inputMatrix = model.getInputMatrix();
+    const std::string matrixPath = vm["output_matrix"].as<std::string>();
+    if (!TMappedMatrix::Save(matrixPath, inputMatrix->data(), inputMatrix->rows(), inputMatrix->cols())) {
+        throw std::runtime_error("Can not write " + matrixPath);
+    }
+    SaveDictionary(model, vm["output_model"].as<std::string>());
+    LOG_DEBUG("Input matrix " << inputMatrix->rows() << "x" << inputMatrix->cols() << " saved to " << matrixPath);
+}
+
+// Writes a text matrix or bias of the sentence embedder in the binary format
+void ConvertEmbedderWeights(const po::variables_map& vm) {
+    const TEmbedderWeights weights = ReadEmbedderWeights(vm["input"].as<std::string>());
+    const std::string output = vm["output"].as<std::string>();
+    if (!TMappedMatrix::Save(output, weights.data(), weights.rows(), weights.cols())) {
+        throw std::runtime_error("Can not write " + output);
+    }
+    LOG_DEBUG("Weights " << weights.rows() << "x" << weights.cols() << " saved to " << output);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        po::options_description desc("options");
+        desc.add_options()
+            ("command", po::value<std::string>()->required(), "command")
+            ("input", po::value<std::string>()->required(), "input")
+            ("output_model", po::value<std::string>(), "output_model")
+            ("output_matrix", po::value<std::string>(), "output_matrix")
+            ("output", po::value<std::string>(), "output")
+            ;
+
+        po::positional_options_description p;
+        p.add("command", 1);
+        p.add("input", 1);
+
+        po::command_line_parser parser{argc, argv};
+        parser.options(desc).positional(p);
+        po::parsed_options parsed_options = parser.run();
+        po::variables_map vm;
+        po::store(parsed_options, vm);
+        po::notify(vm);
+
+        const std::string command = vm["command"].as<std::string>();
+        if (command == "vector_model") {
+            if (!vm.count("output_model") || !vm.count("output_matrix")) {
+                std::cerr << "vector_model needs --output_model and --output_matrix" << std::endl;
+                return -1;
+            }
+            ConvertVectorModel(vm);
+            return 0;
+        } else if (command == "embedder_weights") {
+            if (!vm.count("output")) {
+                std::cerr << "embedder_weights needs --output" << std::endl;
+                return -1;
+            }
+            ConvertEmbedderWeights(vm);
+            return 0;
+        }
+        std::cerr << "Unknown command!" << std::endl;
+        return -1;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+}
@@ -0,0 +1,159 @@
+#include "daemon.h"
+#include "util.h"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+std::string GetErrorMessage(const std::string& prefix) {
+    return prefix + ": " + std::strerror(errno);
+}
+
+bool ReadAll(int descriptor, std::string& data) {
+    char buffer[1 << 16];
+    while (true) {
+        const ssize_t count = ::read(descriptor, buffer, sizeof(buffer));
+        if (count == 0) {
+            return true;
+        }
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.append(buffer, count);
+    }
+}
+
+bool WriteAll(int descriptor, const std::string& data) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+        // A client that went away must not kill the daemon with SIGPIPE
+        const ssize_t count = ::send(descriptor, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        offset += count;
+    }
+    return true;
+}
+
+// Counts running jobs, the accepting thread waits for a free slot before taking a connection
+class TJobSlots {
+public:
+    explicit TJobSlots(size_t maxJobs)
+        : MaxJobs(maxJobs > 0 ? maxJobs : 1)
+    {}
+
+    void Acquire() {
+        std::unique_lock<std::mutex> lock(Mutex);
+        Released.wait(lock, [this] { return Running < MaxJobs; });
+        ++Running;
+    }
+
+    void Release() {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            --Running;
+        }
+        Released.notify_one();
+    }
+
+private:
+    const size_t MaxJobs;
+    size_t Running = 0;
+    std::mutex Mutex;
+    std::condition_variable Released;
+};
+
+void ServeConnection(int descriptor, const TJobHandler& handleJob) {
+    std::string request;
+    if (!ReadAll(descriptor, request)) {
+        LOG_DEBUG(GetErrorMessage("Can't read job"));
+        ::close(descriptor);
+        return;
+    }
+    std::ostringstream response;
+    handleJob(request, response);
+    if (!WriteAll(descriptor, response.str())) {
+        LOG_DEBUG(GetErrorMessage("Can't write job response"));
+    }
+    ::close(descriptor);
+}
+
+void ServeJob(int descriptor, const TJobHandler& handleJob, TJobSlots& slots) {
+    try {
+        ServeConnection(descriptor, handleJob);
+    } catch (std::exception& e) {
+        LOG_DEBUG("Job failed: " << e.what());
+    }
+    slots.Release();
+}
+
+} // namespace
+
+void RunDaemon(const std::string& socketPath, size_t maxJobs, const TJobHandler& handleJob) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + socketPath);
+    }
+    std::strcpy(address.sun_path, socketPath.c_str());
+
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener == -1) {
+        throw std::runtime_error(GetErrorMessage("Can't create socket"));
+    }
+    // A socket file left by a previous daemon would fail the bind, anything else at the path is kept
+    struct stat status;
+    if (::lstat(socketPath.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            ::close(listener);
+            throw std::runtime_error("Path exists and is not a socket: " + socketPath);
+        }
+        ::unlink(socketPath.c_str());
+    } else if (errno != ENOENT) {
+        const std::string message = GetErrorMessage("Can't stat " + socketPath);
+        ::close(listener);
+        throw std::runtime_error(message);
+    }
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(listener, SOMAXCONN) != 0)
+    {
+        const std::string message = GetErrorMessage("Can't listen on " + socketPath);
+        ::close(listener);
+        throw std::runtime_error(message);
+    }
+    LOG_DEBUG("Daemon: listening on " << socketPath);
+    // Never destroyed, the detached job threads release their slots into it
+    TJobSlots& slots = *new TJobSlots(maxJobs);
+    while (true) {
+        slots.Acquire();
+        int descriptor = -1;
+        while (descriptor == -1) {
+            descriptor = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (descriptor == -1 && errno != EINTR && errno != ECONNABORTED) {
+                const std::string message = GetErrorMessage("Can't accept on " + socketPath);
+                ::close(listener);
+                throw std::runtime_error(message);
+            }
+        }
+        std::thread(ServeJob, descriptor, std::cref(handleJob), std::ref(slots)).detach();
+    }
+}
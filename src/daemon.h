@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+
+// Handles the request of a job and writes its response
+using TJobHandler = std::function<void(const std::string& request, std::ostream& response)>;
+
+// Serves jobs on a Unix domain socket, one job per connection: the client writes the request
+// and shuts its side down, the daemon writes the response and closes the connection.
+// Up to maxJobs jobs run concurrently, each on a thread of its own, further connections wait
+// in the listen backlog. Never returns, throws if the socket can not be served.
+void RunDaemon(const std::string& socketPath, size_t maxJobs, const TJobHandler& handleJob);
@@ -1,53 +1,179 @@
 #include "detect.h"
 #include "document.h"
 
-#include <algorithm>
-#include <sstream>
+#include <cstdint>
+#include <cstring>
 
 #include <fasttext.h>
 
-boost::optional<std::pair<std::string, double>> RunFasttextClf(
-    const fasttext::FastText& model,
-    const std::string& originalText,
-    double border)
-{
-    std::string text = originalText;
-    std::replace(text.begin(), text.end(), '\n', ' ');
-    std::istringstream ifs(text);
-    std::vector<std::pair<fasttext::real, std::string>> predictions;
-    model.predictLine(ifs, predictions, 1, border);
-    if (predictions.empty()) {
-        return boost::none;
+namespace {
+
+// Fewer letters are left to the model
+const size_t MIN_SCRIPT_LETTERS = 20;
+// English function words that other Latin languages rarely have. Words like "was", "of", "to",
+// "for" or "are" are frequent in Dutch, German, Scandinavian or Romanian texts and are left out.
+const char* const ENGLISH_WORDS[] = {"the", "and", "that", "from", "this", "with", "has", "have", "were", "they", "said", "its"};
+// Distinct words, a single word repeated proves nothing
+const size_t MIN_ENGLISH_WORDS = 2;
+
+bool InRange(unsigned char ch, unsigned char low, unsigned char high) {
+    return static_cast<unsigned char>(ch - low) <= high - low;
+}
+
+size_t CountEnglishWords(const std::string& sample) {
+    const size_t wordsCount = sizeof(ENGLISH_WORDS) / sizeof(ENGLISH_WORDS[0]);
+    static_assert(wordsCount <= 32, "ENGLISH_WORDS are a bit mask");
+    uint32_t found = 0;
+    size_t begin = 0;
+    for (size_t i = 0; i <= sample.size(); i++) {
+        if (i < sample.size() && InRange(sample[i] | 0x20, 'a', 'z')) {
+            continue;
+        }
+        const size_t length = i - begin;
+        if (length >= 2 && length <= 4) {
+            char word[5] = {};
+            for (size_t j = 0; j < length; j++) {
+                word[j] = sample[begin + j] | 0x20;
+            }
+            for (size_t j = 0; j < wordsCount; j++) {
+                if (std::strcmp(word, ENGLISH_WORDS[j]) == 0) {
+                    found |= 1u << j;
+                }
+            }
+        }
+        begin = i + 1;
     }
-    double probability = predictions[0].first;
-    const size_t FT_PREFIX_LENGTH = 9; // __label__
-    std::string label = predictions[0].second.substr(FT_PREFIX_LENGTH);
-    return std::make_pair(label, probability);
+    size_t count = 0;
+    for (; found != 0; found &= found - 1) {
+        count++;
+    }
+    return count;
+}
+
+} // namespace
+
+TScriptCounts CountScripts(const char* data, size_t size) {
+    TTextScan scan;
+    ScanText(data, size, scan);
+    return scan.Scripts;
+}
+
+boost::optional<std::string> DetectLanguageByScripts(const std::string& sample) {
+    TTextScan scan;
+    ScanText(sample.data(), sample.size(), scan);
+    return DetectLanguageByScripts(sample, scan);
 }
 
-boost::optional<std::string> DetectLanguage(const fasttext::FastText& model, const TDocument& document) {
-    std::string sample(document.Title + " " + document.Description + " " + document.Text.substr(0, 100));
-    auto pair = RunFasttextClf(model, sample, 0.4);
-    if (!pair) {
+boost::optional<std::string> DetectLanguageByScripts(const std::string& sample, const TTextScan& scan) {
+    if (!scan.IsValidUtf8) {
         return boost::none;
     }
-    const std::string& label = pair->first;
-    double probability = pair->second;
-    if ((label == "ru") && probability < 0.6) {
-        return std::string("tg");
+    const TScriptCounts& counts = scan.Scripts;
+    const size_t letters = counts.Latin + counts.Russian + counts.OtherCyrillic + counts.Other;
+    if (letters < MIN_SCRIPT_LETTERS || counts.Other != 0) {
+        return boost::none;
+    }
+    // Latin names are common in Russian news, any letter of another Cyrillic alphabet is not
+    if (counts.OtherCyrillic == 0 && counts.RussianOnly != 0 && counts.Russian * 10 >= letters * 9) {
+        return std::string("ru");
+    }
+    // Many languages are written in ASCII, English is told by its function words
+    if (counts.Latin == letters && CountEnglishWords(sample) >= MIN_ENGLISH_WORDS) {
+        return std::string("en");
+    }
+    return boost::none;
+}
+
+TLanguageDetector::TLanguageDetector(fasttext::FastText& model, bool detectScripts)
+    : Model(model)
+    , Classifier(model)
+    , DetectScripts(detectScripts)
+{
+}
+
+boost::optional<std::string> TLanguageDetector::Detect(const TDocument& document) const {
+    return Detect(std::vector<const TDocument*>(1, &document)).front();
+}
+
+std::vector<boost::optional<std::string>> TLanguageDetector::Detect(const std::vector<const TDocument*>& documents) const {
+    std::vector<boost::optional<std::string>> languages(documents.size());
+    // Documents left to the model
+    std::vector<size_t> indices;
+    std::vector<TTokenIds> samples;
+    TTextScan scan;
+    std::string word;
+    for (size_t i = 0; i < documents.size(); i++) {
+        const TDocument& document = *documents[i];
+        std::string sample(document.Title + " " + document.Description + " " + document.Text.substr(0, LANGUAGE_DETECTION_TEXT_LENGTH));
+        // One pass gives both the scripts and the words for the model
+        ScanText(sample.data(), sample.size(), scan);
+        if (DetectScripts) {
+            languages[i] = DetectLanguageByScripts(sample, scan);
+            if (languages[i]) {
+                if (*languages[i] == "ru") {
+                    RussianByScriptsCount++;
+                } else {
+                    EnglishByScriptsCount++;
+                }
+                continue;
+            }
+        }
+        TTokenResolver resolver(Model, /* addWordNgrams = */ true);
+        for (const auto& bounds : scan.Words) {
+            word.assign(sample, bounds.first, bounds.second - bounds.first);
+            resolver.Add(word);
+        }
+        indices.push_back(i);
+        samples.push_back(resolver.Finish());
+    }
+    if (indices.empty()) {
+        return languages;
     }
-    return label;
+    ByModelCount += indices.size();
+    std::vector<const std::vector<int32_t>*> lines;
+    for (const TTokenIds& sample : samples) {
+        lines.push_back(&sample.Ids);
+    }
+    const std::vector<TFastTextPrediction> predictions = Classifier.Predict(lines, 0.4);
+    for (size_t i = 0; i < predictions.size(); i++) {
+        if (predictions[i].Label < 0) {
+            continue;
+        }
+        const std::string& label = Classifier.GetLabels()[predictions[i].Label];
+        if ((label == "ru") && predictions[i].Probability < 0.6) {
+            languages[indices[i]] = std::string("tg");
+        } else {
+            languages[indices[i]] = label;
+        }
+    }
+    return languages;
+}
+
+TCategoryDetector::TCategoryDetector(fasttext::FastText& model)
+    : Classifier(model)
+{
+    for (const std::string& label : Classifier.GetLabels()) {
+        nlohmann::json category = label;
+        Categories.push_back(category);
+    }
+}
+
+ENewsCategory TCategoryDetector::Detect(const TDocument& document) const {
+    return Detect(std::vector<const TDocument*>(1, &document)).front();
 }
 
-ENewsCategory DetectCategory(const fasttext::FastText& model, const TDocument& document) {
-    if (!document.PreprocessedTitle || !document.PreprocessedText) {
-        return NC_UNDEFINED;
+std::vector<ENewsCategory> TCategoryDetector::Detect(const std::vector<const TDocument*>& documents) const {
+    // The ids are resolved in PreprocessTextFields, nothing is split or hashed here
+    std::vector<const std::vector<int32_t>*> lines;
+    for (const TDocument* document : documents) {
+        lines.push_back(&document->CategoryTokens.Ids);
     }
-    std::string sample(document.PreprocessedTitle.get() + " " + document.PreprocessedText.get());
-    auto pair = RunFasttextClf(model, sample, 0.0);
-    if (!pair) {
-        return NC_UNDEFINED;
+    const std::vector<TFastTextPrediction> predictions = Classifier.Predict(lines, 0.0);
+    std::vector<ENewsCategory> categories(documents.size(), NC_UNDEFINED);
+    for (size_t i = 0; i < predictions.size(); i++) {
+        if (predictions[i].Label >= 0) {
+            categories[i] = Categories[predictions[i].Label];
+        }
     }
-    nlohmann::json category = pair->first;
-    return category;
+    return categories;
 }
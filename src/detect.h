@@ -1,10 +1,59 @@
 #pragma once
 
+#include "classifier.h"
 #include "document.h"
+#include "text_scan.h"
+
+#include <atomic>
 
 namespace fasttext {
     class FastText;
 }
 
-boost::optional<std::string> DetectLanguage(const fasttext::FastText& model, const TDocument& document);
-ENewsCategory DetectCategory(const fasttext::FastText& model, const TDocument& document);
+// Language detection looks only at this many first bytes of the text
+const size_t LANGUAGE_DETECTION_TEXT_LENGTH = 100;
+
+// Script counts of ScanText
+TScriptCounts CountScripts(const char* data, size_t size);
+
+// "ru" for texts in the Russian alphabet, "en" for ASCII texts with English function words,
+// nothing when the script mix is not overwhelming and the model has to decide
+boost::optional<std::string> DetectLanguageByScripts(const std::string& sample);
+// Same with the sample already scanned, samples that are not valid UTF-8 are left to the model
+boost::optional<std::string> DetectLanguageByScripts(const std::string& sample, const TTextScan& scan);
+
+// Language of the title, the description and the beginning of the text
+class TLanguageDetector {
+public:
+    explicit TLanguageDetector(fasttext::FastText& model, bool detectScripts = true);
+
+    boost::optional<std::string> Detect(const TDocument& document) const;
+    std::vector<boost::optional<std::string>> Detect(const std::vector<const TDocument*>& documents) const;
+
+    // Documents decided by scripts and by the model
+    uint64_t GetRussianByScriptsCount() const { return RussianByScriptsCount; }
+    uint64_t GetEnglishByScriptsCount() const { return EnglishByScriptsCount; }
+    uint64_t GetByModelCount() const { return ByModelCount; }
+
+private:
+    const fasttext::FastText& Model;
+    TFastTextClassifier Classifier;
+    const bool DetectScripts;
+    mutable std::atomic<uint64_t> RussianByScriptsCount{0};
+    mutable std::atomic<uint64_t> EnglishByScriptsCount{0};
+    mutable std::atomic<uint64_t> ByModelCount{0};
+};
+
+// Category by the category tokens of the document, see TDocument::PreprocessTextFields.
+// Labels of the model are converted to ENewsCategory once.
+class TCategoryDetector {
+public:
+    explicit TCategoryDetector(fasttext::FastText& model);
+
+    ENewsCategory Detect(const TDocument& document) const;
+    std::vector<ENewsCategory> Detect(const std::vector<const TDocument*>& documents) const;
+
+private:
+    TFastTextClassifier Classifier;
+    std::vector<ENewsCategory> Categories;
+};
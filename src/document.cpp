@@ -1,13 +1,15 @@
 #include "document.h"
+#include "html_scanner.h"
+#include "mapped_file.h"
 #include "util.h"
 
 #include <boost/algorithm/string/predicate.hpp>
-#include <boost/algorithm/string/join.hpp>
-#include <boost/filesystem.hpp>
 #include <tinyxml2/tinyxml2.h>
 
-#include <sstream>
+#include <algorithm>
+#include <cstdio>
 #include <fstream>
+#include <memory>
 
 TDocument::TDocument(const char* fileName) {
     if (boost::algorithm::ends_with(fileName, ".html")) {
@@ -22,6 +24,12 @@ TDocument::TDocument(const nlohmann::json& json) {
 }
 
 nlohmann::json TDocument::ToJson() const {
+    if (!DuplicateOf.empty()) {
+        return nlohmann::json({
+            {"file_name", CleanFileName(FileName)},
+            {"duplicate_of", CleanFileName(DuplicateOf)},
+        });
+    }
     nlohmann::json json({
         {"url", Url},
         {"site_name", SiteName},
@@ -34,6 +42,13 @@ nlohmann::json TDocument::ToJson() const {
     if (!OutLinks.empty()) {
         json["out_links"] = OutLinks;
     }
+    if (!DuplicateFileNames.empty()) {
+        nlohmann::json fileNames = nlohmann::json::array();
+        for (const std::string& fileName : DuplicateFileNames) {
+            fileNames.push_back(CleanFileName(fileName));
+        }
+        json["duplicate_file_names"] = fileNames;
+    }
     if (Language) {
         json["language"] = Language.get();
     }
@@ -51,6 +66,11 @@ void TDocument::FromJson(const char* fileName) {
 }
 
 void TDocument::FromJson(const nlohmann::json& json) {
+    if (json.contains("duplicate_of")) {
+        json.at("file_name").get_to(FileName);
+        json.at("duplicate_of").get_to(DuplicateOf);
+        return;
+    }
     json.at("url").get_to(Url);
     json.at("site_name").get_to(SiteName);
     json.at("timestamp").get_to(FetchTime);
@@ -63,6 +83,9 @@ void TDocument::FromJson(const nlohmann::json& json) {
     if (json.contains("out_links")) {
         json.at("out_links").get_to(OutLinks);
     }
+    if (json.contains("duplicate_file_names")) {
+        json.at("duplicate_file_names").get_to(DuplicateFileNames);
+    }
     if (json.contains("language")) {
         Language = json.at("language");
     }
@@ -71,59 +94,239 @@ void TDocument::FromJson(const nlohmann::json& json) {
     }
 }
 
-std::string GetFullText(const tinyxml2::XMLElement* element) {
-    if (const tinyxml2::XMLText* textNode = element->ToText()) {
-        return textNode->Value();
-    }
-    std::string text;
+namespace {
+
+// Bytes of the text tokenized at once when the tokens are limited, a couple of hundred words
+const size_t TOKENIZATION_PIECE_LENGTH = 2048;
+
+} // namespace
+
+void AppendFullText(const tinyxml2::XMLElement* element, std::string& text, std::vector<std::string>* links) {
+    // Walks the subtree through parent links instead of recursing, so nothing
+    // is allocated besides the growth of the output buffers
     const tinyxml2::XMLNode* node = element->FirstChild();
     while (node) {
-        if (const tinyxml2::XMLElement* elementNode = node->ToElement()) {
-            text += GetFullText(elementNode);
+        if (const tinyxml2::XMLElement* nodeElement = node->ToElement()) {
+            if (links && std::strcmp(nodeElement->Value(), "a") == 0) {
+                if (const char* href = nodeElement->Attribute("href")) {
+                    links->emplace_back(href);
+                }
+            }
+            if (const tinyxml2::XMLNode* child = nodeElement->FirstChild()) {
+                node = child;
+                continue;
+            }
         } else if (const tinyxml2::XMLText* textNode = node->ToText()) {
             text += textNode->Value();
         }
-        node = node->NextSibling();
+        while (node != element && !node->NextSibling()) {
+            node = node->Parent();
+        }
+        node = (node == element) ? nullptr : node->NextSibling();
     }
-    return text;
 }
 
-void ParseLinksFromText(const tinyxml2::XMLElement* element, std::vector<std::string>& links) {
-    const tinyxml2::XMLNode* node = element->FirstChild();
-    while (node) {
-        if (const tinyxml2::XMLElement* nodeElement = node->ToElement()) {
-            if (std::strcmp(nodeElement->Value(), "a") == 0 && nodeElement->Attribute("href")) {
-                links.push_back(nodeElement->Attribute("href"));
+const char* GetParseError(EParseStatus status) {
+    switch (status) {
+        case PS_OK:
+            return "OK";
+        case PS_NO_FILE:
+            return "No HTML file";
+        case PS_NO_HTML:
+            return "Parser error: no html tag";
+        case PS_NO_HEAD:
+            return "Parser error: no head";
+        case PS_NO_META:
+            return "Parser error: no meta";
+        case PS_NO_BODY:
+            return "Parser error: no body";
+        case PS_NO_ARTICLE:
+            return "Parser error: no article";
+        case PS_BAD_DATE:
+            return "wrong date format";
+        default:
+            return "Unknown parse status";
+    }
+}
+
+size_t TDocument::FromHtml(
+    const char* fileName,
+    bool parseLinks,
+    bool shrinkText,
+    size_t maxWords,
+    EHtmlParser parser,
+    const TDocumentFilter& filter,
+    size_t filterTextLength,
+    const TDocumentLimits& limits)
+{
+    size_t skippedBytes = 0;
+    const EParseStatus status = TryFromHtml(
+        fileName, skippedBytes, parseLinks, shrinkText, maxWords, parser, filter, filterTextLength, limits);
+    if (status != PS_OK) {
+        throw std::runtime_error(GetParseError(status));
+    }
+    return skippedBytes;
+}
+
+size_t TDocument::FromHtmlBuffer(
+    const char* data,
+    size_t size,
+    bool parseLinks,
+    bool shrinkText,
+    size_t maxWords,
+    const TDocumentFilter& filter,
+    size_t filterTextLength,
+    const TDocumentLimits& limits)
+{
+    size_t skippedBytes = 0;
+    const EParseStatus status = TryFromHtmlBuffer(
+        data, size, skippedBytes, parseLinks, shrinkText, maxWords, filter, filterTextLength, limits);
+    if (status != PS_OK) {
+        throw std::runtime_error(GetParseError(status));
+    }
+    return skippedBytes;
+}
+
+EParseStatus TDocument::TryFromHtml(
+    const char* fileName,
+    size_t& skippedBytes,
+    bool parseLinks,
+    bool shrinkText,
+    size_t maxWords,
+    EHtmlParser parser,
+    const TDocumentFilter& filter,
+    size_t filterTextLength,
+    const TDocumentLimits& limits)
+{
+    skippedBytes = 0;
+    if (parser == HP_TINYXML) {
+        const EParseStatus status = FromTinyXml(fileName, parseLinks, shrinkText, maxWords, limits);
+        if (status == PS_OK && filter) {
+            filter(*this);
+        }
+        return status;
+    }
+    TMappedFile file;
+    if (!file.Open(fileName, /* populate = */ true, GetMaxReadBytes(limits))) {
+        return PS_NO_FILE;
+    }
+    FileName = fileName;
+    return TryFromHtmlBuffer(
+        file.Data(), file.Size(), skippedBytes, parseLinks, shrinkText, maxWords, filter, filterTextLength, limits);
+}
+
+EParseStatus TDocument::TryFromHtmlBuffer(
+    const char* data,
+    size_t size,
+    size_t& skippedBytes,
+    bool parseLinks,
+    bool shrinkText,
+    size_t maxWords,
+    const TDocumentFilter& filter,
+    size_t filterTextLength,
+    const TDocumentLimits& limits)
+{
+    skippedBytes = 0;
+    THtmlScanner scanner(parseLinks, shrinkText, maxWords, limits);
+    THtmlScanResult page;
+    bool isScanned = scanner.Scan(data, size, page, filter ? std::max<size_t>(filterTextLength, 1) : 0);
+    bool isFiltered = false;
+    if (scanner.IsPaused()) {
+        // Only the fields that can not fail, the rest is checked after the full scan
+        for (const THtmlScanResult::TMeta& meta : page.Metas) {
+            if (meta.Property == "og:title") {
+                Title = meta.Content;
             }
-            ParseLinksFromText(nodeElement, links);
+            if (meta.Property == "og:description") {
+                Description = meta.Content;
+            }
+        }
+        Text = page.Text;
+        if (!filter(*this)) {
+            skippedBytes = scanner.GetRemainingSize();
+            return PS_OK;
         }
-        node = node->NextSibling();
+        isFiltered = true;
+        isScanned = scanner.Resume();
+    }
+    if (!isScanned || !page.HasHtml) {
+        return PS_NO_HTML;
+    }
+    if (!page.HasHead) {
+        return PS_NO_HEAD;
+    }
+    if (!page.HasMeta) {
+        return PS_NO_META;
     }
+    for (const THtmlScanResult::TMeta& meta : page.Metas) {
+        if (meta.Property == "og:title") {
+            Title = meta.Content;
+        }
+        if (meta.Property == "og:url") {
+            Url = meta.Content;
+        }
+        if (meta.Property == "og:site_name") {
+            SiteName = meta.Content;
+        }
+        if (meta.Property == "og:description") {
+            Description = meta.Content;
+        }
+        if (meta.Property == "article:published_time" && !ParseDate(meta.Content, FetchTime)) {
+            return PS_BAD_DATE;
+        }
+    }
+    if (!page.HasBody) {
+        return PS_NO_BODY;
+    }
+    if (!page.HasArticle) {
+        return PS_NO_ARTICLE;
+    }
+    Text = std::move(page.Text);
+    Text.shrink_to_fit();
+    OutLinks = std::move(page.OutLinks);
+    TruncatedLimits = page.TruncatedLimits;
+    if (page.HasAddress) {
+        if (page.Time && !ParseDate(page.Time.get(), PubTime)) {
+            return PS_BAD_DATE;
+        }
+        if (page.Author) {
+            Author = std::move(page.Author.get());
+        }
+    }
+    if (filter && !isFiltered) {
+        filter(*this);
+    }
+    return PS_OK;
 }
 
-void TDocument::FromHtml(
+EParseStatus TDocument::FromTinyXml(
     const char* fileName,
     bool parseLinks,
     bool shrinkText,
-    size_t maxWords)
+    size_t maxWords,
+    const TDocumentLimits& limits)
 {
-    if (!boost::filesystem::exists(fileName)) {
-        throw std::runtime_error("No HTML file");
+    std::unique_ptr<std::FILE, int(*)(std::FILE*)> file(std::fopen(fileName, "rb"), std::fclose);
+    if (!file) {
+        return PS_NO_FILE;
     }
     FileName = fileName;
     tinyxml2::XMLDocument originalDoc;
-    originalDoc.LoadFile(fileName);
+    // Parse would drop the tree on an error, LoadFile keeps what was parsed before it
+    originalDoc.LoadFile(file.get());
+    // LoadFile reads the whole file, so the position is its size
+    const long fileSize = std::ftell(file.get());
     const tinyxml2::XMLElement* htmlElement = originalDoc.FirstChildElement("html");
     if (!htmlElement) {
-        throw std::runtime_error("Parser error: no html tag");
+        return PS_NO_HTML;
     }
     const tinyxml2::XMLElement* headElement = htmlElement->FirstChildElement("head");
     if (!headElement) {
-        throw std::runtime_error("Parser error: no head");
+        return PS_NO_HEAD;
     }
     const tinyxml2::XMLElement* metaElement = headElement->FirstChildElement("meta");
     if (!metaElement) {
-        throw std::runtime_error("Parser error: no meta");
+        return PS_NO_META;
     }
     while (metaElement != 0) {
         const char* property = metaElement->Attribute("property");
@@ -144,61 +347,128 @@ void TDocument::FromHtml(
         if (std::strcmp(property, "og:description") == 0) {
             Description = content;
         }
-        if (std::strcmp(property, "article:published_time") == 0) {
-            FetchTime = DateToTimestamp(content);
+        if (std::strcmp(property, "article:published_time") == 0 && !ParseDate(content, FetchTime)) {
+            return PS_BAD_DATE;
         }
         metaElement = metaElement->NextSiblingElement("meta");
     }
     const tinyxml2::XMLElement* bodyElement = htmlElement->FirstChildElement("body");
     if (!bodyElement) {
-        throw std::runtime_error("Parser error: no body");
+        return PS_NO_BODY;
     }
     const tinyxml2::XMLElement* articleElement = bodyElement->FirstChildElement("article");
     if (!articleElement) {
-        throw std::runtime_error("Parser error: no article");
+        return PS_NO_ARTICLE;
     }
     const tinyxml2::XMLElement* pElement = articleElement->FirstChildElement("p");
     {
-        std::vector<std::string> links;
+        if (fileSize > 0) {
+            Text.reserve(static_cast<size_t>(fileSize) / HTML_BYTES_PER_TEXT_BYTE);
+        }
         size_t wordCount = 0;
+        size_t paragraphCount = 0;
+        // Same cuts as THtmlScanner makes
         while (pElement && (!shrinkText || wordCount < maxWords)) {
-            std::string pText = GetFullText(pElement);
+            if (limits.MaxParagraphs != 0 && paragraphCount == limits.MaxParagraphs) {
+                TruncatedLimits |= 1u << DL_PARAGRAPHS;
+                break;
+            }
+            const size_t pStart = Text.size();
+            AppendFullText(pElement, Text, parseLinks ? &OutLinks : nullptr);
+            if (limits.MaxOutLinks != 0 && OutLinks.size() > limits.MaxOutLinks) {
+                OutLinks.resize(limits.MaxOutLinks);
+                TruncatedLimits |= 1u << DL_OUT_LINKS;
+            }
+            const bool isTextFull = limits.MaxTextLength != 0 && Text.size() > limits.MaxTextLength;
+            if (isTextFull) {
+                TruncateUtf8(Text, limits.MaxTextLength);
+                TruncatedLimits |= 1u << DL_TEXT_LENGTH;
+            }
             if (shrinkText) {
-                std::istringstream iss(pText);
-                std::string word;
-                while (iss >> word) {
-                    wordCount++;
-                }
+                wordCount += CountWords(Text, pStart);
             }
-            Text += pText + "\n";
-            if (parseLinks) {
-                ParseLinksFromText(pElement, links);
+            Text += '\n';
+            paragraphCount++;
+            if (isTextFull) {
+                break;
             }
             pElement = pElement->NextSiblingElement("p");
         }
-        OutLinks = std::move(links);
+        // The reserve is a guess, saved documents keep only what the text needs
+        Text.shrink_to_fit();
     }
     const tinyxml2::XMLElement* addressElement = articleElement->FirstChildElement("address");
     if (!addressElement) {
-        return;
+        return PS_OK;
     }
     const tinyxml2::XMLElement* timeElement = addressElement->FirstChildElement("time");
-    if (timeElement && timeElement->Attribute("datetime")) {
-        PubTime = DateToTimestamp(timeElement->Attribute("datetime"));
+    if (timeElement && timeElement->Attribute("datetime") && !ParseDate(timeElement->Attribute("datetime"), PubTime)) {
+        return PS_BAD_DATE;
     }
     const tinyxml2::XMLElement* aElement = addressElement->FirstChildElement("a");
     if (aElement && aElement->Attribute("rel") && std::string(aElement->Attribute("rel")) == "author") {
-        Author = aElement->GetText();
+        // An empty link has no text
+        if (const char* author = aElement->GetText()) {
+            Author = author;
+        }
     }
+    return PS_OK;
 }
 
-std::string Preprocess(const std::string& text, const onmt::Tokenizer& tokenizer) {
+bool TDocument::PreprocessTextFields(
+    const onmt::Tokenizer& tokenizer,
+    const fasttext::FastText& categoryModel,
+    const fasttext::FastText* vectorModel,
+    const TTokenLimits& limits)
+{
+    TTokenResolver categoryResolver(categoryModel, /* addWordNgrams = */ true, limits.MaxCategoryTokens);
+    std::unique_ptr<TTokenResolver> vectorResolver;
+    if (vectorModel) {
+        vectorResolver.reset(new TTokenResolver(*vectorModel, /* addWordNgrams = */ false, limits.MaxVectorTokens));
+    }
+    auto isFull = [&]() {
+        return categoryResolver.IsFull() && (!vectorResolver || vectorResolver->IsFull());
+    };
     std::vector<std::string> tokens;
-    tokenizer.tokenize(text, tokens);
-    return boost::join(tokens, " ");
-}
+    auto resolve = [&]() {
+        for (const std::string& token : tokens) {
+            categoryResolver.Add(token);
+            if (vectorResolver) {
+                vectorResolver->Add(token);
+            }
+            if (isFull()) {
+                break;
+            }
+        }
+    };
+    tokenizer.tokenize(Title, tokens);
+    resolve();
+    categoryResolver.EndTitle();
+    if (vectorResolver) {
+        vectorResolver->EndTitle();
+    }
 
-void TDocument::PreprocessTextFields(const onmt::Tokenizer& tokenizer) {
-    PreprocessedTitle = Preprocess(Title, tokenizer);
-    PreprocessedText = Preprocess(Text, tokenizer);
+    // Without limits the text is tokenized at once. Otherwise it goes in pieces
+    // cut at spaces, no token spans them, until every model has enough words.
+    const bool isLimited = limits.MaxCategoryTokens != 0 && (!vectorResolver || limits.MaxVectorTokens != 0);
+    const size_t pieceLength = isLimited ? TOKENIZATION_PIECE_LENGTH : Text.size();
+    size_t begin = 0;
+    while (begin < Text.size() && !isFull()) {
+        size_t end = std::min(begin + pieceLength, Text.size());
+        while (end < Text.size() && Text[end] != ' ' && Text[end] != '\n') {
+            end++;
+        }
+        if (begin == 0 && end == Text.size()) {
+            tokenizer.tokenize(Text, tokens);
+        } else {
+            tokenizer.tokenize(Text.substr(begin, end - begin), tokens);
+        }
+        resolve();
+        begin = end;
+    }
+    CategoryTokens = categoryResolver.Finish();
+    if (vectorResolver) {
+        VectorTokens = vectorResolver->Finish();
+    }
+    return begin >= Text.size();
 }
@@ -1,8 +1,12 @@
 #pragma once
 
+#include "html_scanner.h"
+#include "token_ids.h"
+
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <functional>
 
 #include <boost/optional.hpp>
 #include <nlohmann_json/json.hpp>
@@ -36,6 +40,48 @@ NLOHMANN_JSON_SERIALIZE_ENUM(ENewsCategory, {
     {NC_NOT_NEWS, "not_news"},
 })
 
+enum EHtmlParser {
+    HP_STREAMING = 0,
+    HP_TINYXML = 1
+};
+
+// Why a page is rejected, see TDocument::TryFromHtml
+enum EParseStatus {
+    PS_OK = 0,
+    PS_NO_FILE,
+    PS_NO_HTML,
+    PS_NO_HEAD,
+    PS_NO_META,
+    PS_NO_BODY,
+    PS_NO_ARTICLE,
+    PS_BAD_DATE,
+
+    PS_COUNT
+};
+
+// Message of the exception FromHtml throws for the status
+const char* GetParseError(EParseStatus status);
+
+// Words of the title and the text each model reads at most, zero means all of them.
+// The text is tokenized only as far as the models need.
+struct TTokenLimits {
+    size_t MaxCategoryTokens = 0;
+    size_t MaxVectorTokens = 0;
+};
+
+namespace tinyxml2 {
+    class XMLElement;
+}
+
+namespace fasttext {
+    class FastText;
+}
+
+struct TDocument;
+
+// Decides whether a page is worth parsing to the end, may annotate it on the way
+using TDocumentFilter = std::function<bool(TDocument&)>;
+
 struct TDocument {
 public:
     // Original fields
@@ -51,12 +97,26 @@ public:
     uint64_t FetchTime = 0;
 
     std::vector<std::string> OutLinks;
+    // Bits of EDocumentLimit for the limits the page went over while parsing
+    uint32_t TruncatedLimits = 0;
 
     // Calculated fields
-    boost::optional<std::string> PreprocessedTitle;
-    boost::optional<std::string> PreprocessedText;
     boost::optional<std::string> Language;
     ENewsCategory Category = NC_UNDEFINED;
+    // Tokens of the title and the text in the category and the vector models of the language
+    TTokenIds CategoryTokens;
+    TTokenIds VectorTokens;
+    // Fingerprints of the url and the text, see TDuplicateFilter
+    uint64_t UrlHash = 0;
+    uint64_t TextHash = 0;
+    // Files of the copies folded into this document
+    std::vector<std::string> DuplicateFileNames;
+    // File of the document this one is a copy of. Such a copy has nothing but the two
+    // file names, JSON Lines write it when it is found after its document was written.
+    std::string DuplicateOf;
+    // Set from THostTable before clustering
+    uint32_t HostId = 0;
+    double AgencyScore = 0.0;
 
 public:
     TDocument() = default;
@@ -66,14 +126,74 @@ public:
     nlohmann::json ToJson() const;
     void FromJson(const char* fileName);
     void FromJson(const nlohmann::json& json);
-    void FromHtml(
+    // The filter is called once the head and the first filterTextLength bytes
+    // of the text are known. If it declines, the rest of the page is not parsed
+    // and the number of skipped bytes is returned.
+    // The tinyxml2 parser needs the whole file, so it ignores the byte limit.
+    size_t FromHtml(
         const char* fileName,
         bool parseLinks=false,
         bool shrinkText=false,
-        size_t maxWords=200
+        size_t maxWords=200,
+        EHtmlParser parser=HP_STREAMING,
+        const TDocumentFilter& filter=nullptr,
+        size_t filterTextLength=0,
+        const TDocumentLimits& limits=TDocumentLimits()
+    );
+    size_t FromHtmlBuffer(
+        const char* data,
+        size_t size,
+        bool parseLinks=false,
+        bool shrinkText=false,
+        size_t maxWords=200,
+        const TDocumentFilter& filter=nullptr,
+        size_t filterTextLength=0,
+        const TDocumentLimits& limits=TDocumentLimits()
+    );
+    // Same without exceptions for rejected pages, the number FromHtml returns goes to skippedBytes
+    EParseStatus TryFromHtml(
+        const char* fileName,
+        size_t& skippedBytes,
+        bool parseLinks=false,
+        bool shrinkText=false,
+        size_t maxWords=200,
+        EHtmlParser parser=HP_STREAMING,
+        const TDocumentFilter& filter=nullptr,
+        size_t filterTextLength=0,
+        const TDocumentLimits& limits=TDocumentLimits()
+    );
+    EParseStatus TryFromHtmlBuffer(
+        const char* data,
+        size_t size,
+        size_t& skippedBytes,
+        bool parseLinks=false,
+        bool shrinkText=false,
+        size_t maxWords=200,
+        const TDocumentFilter& filter=nullptr,
+        size_t filterTextLength=0,
+        const TDocumentLimits& limits=TDocumentLimits()
     );
     bool IsRussian() const { return Language && Language.get() == "ru"; }
     bool IsEnglish() const { return Language && Language.get() == "en"; }
     bool IsNews() const { return Category != NC_NOT_NEWS && Category != NC_UNDEFINED; }
-    void PreprocessTextFields(const onmt::Tokenizer& tokenizer);
+    // Tokenizes the title and the text once and resolves the tokens for both models,
+    // the vector model may be skipped when no embeddings are needed.
+    // Returns false if the text was not tokenized to the end.
+    bool PreprocessTextFields(
+        const onmt::Tokenizer& tokenizer,
+        const fasttext::FastText& categoryModel,
+        const fasttext::FastText* vectorModel = nullptr,
+        const TTokenLimits& limits = TTokenLimits());
+
+private:
+    EParseStatus FromTinyXml(
+        const char* fileName,
+        bool parseLinks,
+        bool shrinkText,
+        size_t maxWords,
+        const TDocumentLimits& limits
+    );
 };
+
+// Appends the text of every descendant of the element, collecting <a href> links if asked
+void AppendFullText(const tinyxml2::XMLElement* element, std::string& text, std::vector<std::string>* links = nullptr);
@@ -0,0 +1,120 @@
+#include "duplicates.h"
+#include "document.h"
+
+namespace {
+
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t Hash(uint64_t hash, unsigned char ch) {
+    return (hash ^ ch) * FNV_PRIME;
+}
+
+uint64_t GetStringFingerprint(const std::string& value) {
+    if (value.empty()) {
+        return 0;
+    }
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (char ch : value) {
+        hash = Hash(hash, ch);
+    }
+    return hash;
+}
+
+bool IsSpace(char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t' || ch == '\v' || ch == '\f';
+}
+
+} // namespace
+
+uint64_t GetTextFingerprint(const std::string& text) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    bool isEmpty = true;
+    bool isSpace = false;
+    for (char ch : text) {
+        if (IsSpace(ch)) {
+            isSpace = true;
+            continue;
+        }
+        if (isSpace && !isEmpty) {
+            hash = Hash(hash, ' ');
+        }
+        isSpace = false;
+        isEmpty = false;
+        hash = Hash(hash, (ch >= 'A' && ch <= 'Z') ? ch - 'A' + 'a' : ch);
+    }
+    return isEmpty ? 0 : hash;
+}
+
+uint64_t GetUrlFingerprint(const std::string& url) {
+    return GetStringFingerprint(url);
+}
+
+bool TDuplicateFilter::Claim(TDocument& document, uint64_t ordinal) {
+    document.UrlHash = GetUrlFingerprint(document.Url);
+    document.TextHash = GetTextFingerprint(document.Text);
+    std::unique_lock<std::mutex> lock(Mutex);
+    // Both are claimed, a copy by url may still be the first copy of its text
+    const bool isUrlFirst = Claim(UrlOrdinals, document.UrlHash, ordinal);
+    const bool isTextFirst = Claim(TextOrdinals, document.TextHash, ordinal);
+    return isUrlFirst && isTextFirst;
+}
+
+bool TDuplicateFilter::Claim(std::unordered_map<uint64_t, uint64_t>& ordinals, uint64_t fingerprint, uint64_t ordinal) {
+    if (fingerprint == 0) {
+        return true;
+    }
+    auto it = ordinals.emplace(fingerprint, ordinal).first;
+    if (it->second < ordinal) {
+        return false;
+    }
+    it->second = ordinal;
+    return true;
+}
+
+bool TDuplicateFolder::Fold(TDocument& document, std::vector<TDocument>& docs, size_t* foldedPosition) {
+    size_t position = NOT_SAVED;
+    auto urlIt = UrlPositions.find(document.UrlHash);
+    auto textIt = TextPositions.find(document.TextHash);
+    if (!document.DuplicateOf.empty()) {
+        // A copy of an unknown document is dropped
+        auto fileNameIt = FileNamePositions.find(GetStringFingerprint(document.DuplicateOf));
+        if (fileNameIt != FileNamePositions.end()) {
+            position = fileNameIt->second;
+        }
+    } else if (document.UrlHash != 0 && urlIt != UrlPositions.end()) {
+        position = urlIt->second;
+    } else if (document.TextHash != 0 && textIt != TextPositions.end()) {
+        position = textIt->second;
+    } else {
+        return false;
+    }
+    if (foldedPosition) {
+        *foldedPosition = position;
+    }
+    // Copies of this one are copies of the first document too
+    Add(document, position);
+    if (position == NOT_SAVED) {
+        DroppedCount++;
+        return true;
+    }
+    TDocument& original = docs[position];
+    original.DuplicateFileNames.push_back(std::move(document.FileName));
+    for (std::string& fileName : document.DuplicateFileNames) {
+        original.DuplicateFileNames.push_back(std::move(fileName));
+    }
+    FoldedCount++;
+    return true;
+}
+
+void TDuplicateFolder::Add(const TDocument& document, size_t position) {
+    if (document.UrlHash != 0) {
+        UrlPositions.emplace(document.UrlHash, position);
+    }
+    if (document.TextHash != 0) {
+        TextPositions.emplace(document.TextHash, position);
+    }
+    if (!document.FileName.empty()) {
+        FileNamePositions.emplace(GetStringFingerprint(document.FileName), position);
+    }
+}
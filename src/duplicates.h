@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TDocument;
+
+// Hash of the text with ASCII letters lowercased and whitespace runs collapsed, 0 for blank texts
+uint64_t GetTextFingerprint(const std::string& text);
+// Hash of the url, 0 for empty urls
+uint64_t GetUrlFingerprint(const std::string& url);
+
+// Copies are documents with the same url or the same text fingerprint. Shared by the annotation
+// tasks: of all copies the one with the smallest ordinal wins whatever order the tasks come in,
+// the others may skip the expensive stages.
+class TDuplicateFilter {
+public:
+    // Sets the fingerprints of the document, returns false if a copy with a smaller ordinal is known
+    bool Claim(TDocument& document, uint64_t ordinal);
+
+private:
+    static bool Claim(std::unordered_map<uint64_t, uint64_t>& ordinals, uint64_t fingerprint, uint64_t ordinal);
+
+private:
+    std::mutex Mutex;
+    std::unordered_map<uint64_t, uint64_t> UrlOrdinals;
+    std::unordered_map<uint64_t, uint64_t> TextOrdinals;
+};
+
+// Documents in the output order by their fingerprints. A later copy is folded into the saved
+// document, which keeps its file names, or dropped if the first copy was not saved.
+// Copies with TDocument::DuplicateOf are folded by the file name of their document.
+class TDuplicateFolder {
+public:
+    static const size_t NOT_SAVED = std::numeric_limits<size_t>::max();
+
+    // Returns false if the document is not a copy of an earlier one.
+    // Otherwise position is set to where it is folded into, or NOT_SAVED.
+    bool Fold(TDocument& document, std::vector<TDocument>& docs, size_t* position = nullptr);
+    // The position of the document in docs, or NOT_SAVED
+    void Add(const TDocument& document, size_t position);
+
+    size_t GetFoldedCount() const { return FoldedCount; }
+    size_t GetDroppedCount() const { return DroppedCount; }
+
+private:
+    std::unordered_map<uint64_t, size_t> UrlPositions;
+    std::unordered_map<uint64_t, size_t> TextPositions;
+    std::unordered_map<uint64_t, size_t> FileNamePositions;
+    size_t FoldedCount = 0;
+    size_t DroppedCount = 0;
+};
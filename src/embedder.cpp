@@ -1,81 +1,125 @@
 #include "embedder.h"
 #include "document.h"
+#include "mapped_matrix.h"
 
-#include <sstream>
 #include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
 
 #include <onmt/Tokenizer.h>
 
+TEmbedderWeights ReadEmbedderWeights(const std::string& fileName) {
+    TMappedMatrix mappedWeights;
+    if (mappedWeights.Open(fileName)) {
+        return Eigen::Map<const TEmbedderWeights>(mappedWeights.Data(), mappedWeights.Rows(), mappedWeights.Cols());
+    }
+    std::ifstream in(fileName);
+    if (!in) {
+        throw std::runtime_error("Can not open " + fileName);
+    }
+    std::vector<float> values;
+    size_t rows = 0;
+    size_t cols = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t rowBegin = values.size();
+        const char* ptr = line.c_str();
+        while (true) {
+            while (*ptr == ' ' || *ptr == ',' || *ptr == '\r') {
+                ptr++;
+            }
+            if (*ptr == '\0') {
+                break;
+            }
+            char* numberEnd = nullptr;
+            values.push_back(std::strtof(ptr, &numberEnd));
+            if (numberEnd == ptr) {
+                throw std::runtime_error("Bad number in " + fileName + ": " + line);
+            }
+            ptr = numberEnd;
+        }
+        const size_t rowSize = values.size() - rowBegin;
+        if (rowSize == 0) {
+            continue;
+        }
+        if (rows != 0 && rowSize != cols) {
+            throw std::runtime_error("Rows of different length in " + fileName);
+        }
+        cols = rowSize;
+        rows++;
+    }
+    if (rows == 0) {
+        throw std::runtime_error("No weights in " + fileName);
+    }
+    return Eigen::Map<const TEmbedderWeights>(values.data(), rows, cols);
+}
+
 TFastTextEmbedder::TFastTextEmbedder(
     fasttext::FastText& model
     , TFastTextEmbedder::AggregationMode mode
     , size_t maxWords
     , const std::string& matrixPath
     , const std::string& biasPath
+    , const TMappedMatrix* inputMatrix
 )
     : Model(model)
+    , Dimension(model.getDimension())
     , Mode(mode)
     , MaxWords(maxWords)
-    , Matrix(model.getDimension() * 3, 50)
-    , Bias(50)
 {
-    if (matrixPath.empty()) {
+    if (inputMatrix) {
+        InputRows = inputMatrix->Data();
+    } else {
+        ModelInputMatrix = model.getInputMatrix();
+        if (ModelInputMatrix->rows() == 0) {
+            throw std::runtime_error("Vector model has no input matrix, it has to be mapped");
+        }
+        InputRows = ModelInputMatrix->data();
+    }
+    if (Mode != AM_Matrix) {
         return;
     }
-    std::ifstream matrixIn(matrixPath);
-    std::string line;
-    int row = 0;
-    int col = 0;
-    while (std::getline(matrixIn, line)) {
-        std::string num;
-        for (char ch : line) {
-            if (ch == ' ') {
-                continue;
-            }
-            if (ch != ',' && ch != '\n') {
-                num += ch;
-                continue;
-            }
-            Matrix(col++, row) = std::stof(num);
-            num = "";
-        }
-        if (!num.empty()) {
-            Matrix(col, row) = std::stof(num);
-            num = "";
-        }
-        col = 0;
-        row++;
+    // A row of the file is an output, its columns are the average, max and min vectors.
+    // The output size is the number of rows.
+    Matrix = ReadEmbedderWeights(matrixPath).transpose();
+    if (static_cast<size_t>(Matrix.rows()) != Dimension * 3) {
+        throw std::runtime_error("Matrix " + matrixPath + " does not match the vector model dimension");
     }
-    matrixIn.close();
-    assert(row != 0);
-    assert(row == 50);
-
-    std::ifstream biasIn(biasPath);
-    row = 0;
-    while (std::getline(biasIn, line)) {
-        Bias(row++) = std::stof(line);
+    const TEmbedderWeights bias = ReadEmbedderWeights(biasPath);
+    if (bias.cols() != 1 || bias.rows() != Matrix.cols()) {
+        throw std::runtime_error("Bias " + biasPath + " does not match the matrix");
     }
-    biasIn.close();
+    Bias = bias.col(0);
 }
 
 size_t TFastTextEmbedder::GetEmbeddingSize() const {
-    return Model.getDimension();
+    return Mode == AM_Matrix ? Matrix.cols() : Dimension;
 }
 
 fasttext::Vector TFastTextEmbedder::GetSentenceEmbedding(const TDocument& doc) const {
-    assert(doc.PreprocessedTitle && doc.PreprocessedText);
-    std::istringstream ss(doc.PreprocessedTitle.get() + " " + doc.PreprocessedText.get());
-    fasttext::Vector wordVector(GetEmbeddingSize());
-    fasttext::Vector avgVector(GetEmbeddingSize());
-    fasttext::Vector maxVector(GetEmbeddingSize());
-    fasttext::Vector minVector(GetEmbeddingSize());
-    std::string word;
+    const TTokenIds& tokens = doc.VectorTokens;
+    fasttext::Vector wordVector(Dimension);
+    fasttext::Vector avgVector(Dimension);
+    fasttext::Vector maxVector(Dimension);
+    fasttext::Vector minVector(Dimension);
     size_t count = 0;
-    while (ss >> word) {
+    for (size_t tokenIndex = 0; tokenIndex < tokens.Size(); tokenIndex++) {
         if (count > MaxWords) {
             break;
         }
-        Model.getWordVector(wordVector, word);
+        // Same as FastText::getWordVector, the subwords were looked up once in PreprocessTextFields
+        wordVector.zero();
+        Eigen::Map<Eigen::VectorXf> word(wordVector.data(), Dimension);
+        const uint32_t begin = tokens.Offsets[tokenIndex];
+        const uint32_t end = tokens.Offsets[tokenIndex + 1];
+        for (uint32_t i = begin; i < end; i++) {
+            word += Eigen::Map<const Eigen::VectorXf>(InputRows + tokens.Ids[i] * Dimension, Dimension);
+        }
+        if (end > begin) {
+            wordVector.mul(1.0 / (end - begin));
+        }
         float norm = wordVector.norm();
         if (norm < 0.0001f) {
             continue;
@@ -87,7 +131,7 @@ fasttext::Vector TFastTextEmbedder::GetSentenceEmbedding(const TDocument& doc) c
             maxVector = wordVector;
             minVector = wordVector;
         } else {
-            for (size_t i = 0; i < GetEmbeddingSize(); i++) {
+            for (size_t i = 0; i < Dimension; i++) {
                 maxVector[i] = std::max(maxVector[i], wordVector[i]);
                 minVector[i] = std::min(minVector[i], wordVector[i]);
             }
@@ -105,16 +149,13 @@ fasttext::Vector TFastTextEmbedder::GetSentenceEmbedding(const TDocument& doc) c
         return maxVector;
     }
     assert(Mode == AM_Matrix);
-    fasttext::Vector resultVector(GetEmbeddingSize());
-    Eigen::VectorXf concatVector(GetEmbeddingSize() * 3);
-    for (size_t i = 0; i < GetEmbeddingSize(); i++) {
+    Eigen::VectorXf concatVector(Dimension * 3);
+    for (size_t i = 0; i < Dimension; i++) {
         concatVector[i] = avgVector[i];
-        concatVector[GetEmbeddingSize() + i] = maxVector[i];
-        concatVector[2 * GetEmbeddingSize() + i] = minVector[i];
-    }
-    auto eigenResult = ((Matrix.transpose() * concatVector) + Bias).transpose();
-    for (size_t i = 0; i < GetEmbeddingSize(); i++) {
-        resultVector[i] = eigenResult(0, i);
+        concatVector[Dimension + i] = maxVector[i];
+        concatVector[2 * Dimension + i] = minVector[i];
     }
+    fasttext::Vector resultVector(GetEmbeddingSize());
+    Eigen::Map<Eigen::VectorXf>(resultVector.data(), GetEmbeddingSize()) = (Matrix.transpose() * concatVector) + Bias;
     return resultVector;
 }
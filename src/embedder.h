@@ -3,8 +3,19 @@
 #include <fasttext.h>
 #include <Eigen/Core>
 
+#include <memory>
+#include <string>
+
+class TMappedMatrix;
 struct TDocument;
 
+// Weights of the sentence embedder as they are stored, a row of a file is a row here
+using TEmbedderWeights = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// Reads the comma separated text files of the training notebooks or the binary ones
+// tgnews_convert writes, the shape comes from the file
+TEmbedderWeights ReadEmbedderWeights(const std::string& fileName);
+
 class TFastTextEmbedder {
 public:
     enum AggregationMode {
@@ -19,16 +30,24 @@ public:
         AggregationMode mode = AM_Avg,
         size_t maxWords = 100,
         const std::string& matrixPath = "",
-        const std::string& biasPath = "");
+        const std::string& biasPath = "",
+        const TMappedMatrix* inputMatrix = nullptr);
     virtual ~TFastTextEmbedder() = default;
 
+    // Dimension of the vector model, or the number of outputs of the matrix
     size_t GetEmbeddingSize() const;
     fasttext::Vector GetSentenceEmbedding(const TDocument& doc) const;
 
 private:
     fasttext::FastText& Model;
+    size_t Dimension;
+    // Word vectors are averaged from the input rows by the pre-resolved subword ids.
+    // The rows are the model's own or a mapped matrix, then the model holds only the dictionary.
+    std::shared_ptr<const fasttext::DenseMatrix> ModelInputMatrix;
+    const float* InputRows = nullptr;
     AggregationMode Mode;
     size_t MaxWords;
+    // Inputs by outputs
     Eigen::MatrixXf Matrix;
     Eigen::VectorXf Bias;
 };
@@ -0,0 +1,578 @@
+#include "file_reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+TReadBudget::TReadBudget(size_t maxBytes)
+    : MaxBytes(maxBytes)
+{}
+
+bool TReadBudget::TryAcquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (Bytes != 0 && Bytes + bytes > MaxBytes) {
+        return false;
+    }
+    Bytes += bytes;
+    return true;
+}
+
+void TReadBudget::Acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    Condition.wait(lock, [&] { return Bytes == 0 || Bytes + bytes <= MaxBytes; });
+    Bytes += bytes;
+}
+
+void TReadBudget::Release(size_t bytes) {
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        Bytes -= bytes;
+    }
+    Condition.notify_all();
+}
+
+TFileData::TFileData(const std::string& fileName, std::shared_ptr<TReadBudget> budget)
+    : FileName(fileName)
+    , Budget(std::move(budget))
+{}
+
+TFileData::~TFileData() {
+    if (BudgetBytes != 0) {
+        Budget->Release(BudgetBytes);
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+// Bare io_uring on raw syscalls, liburing is not required
+struct TFileReader::TRing {
+    struct TSlot {
+        TRequest Request;
+        TFileDataPtr Data;
+        int Descriptor = -1;
+        size_t Offset = 0;
+        bool IsOpened = false;
+    };
+
+    int Descriptor = -1;
+    void* SqPointer = MAP_FAILED;
+    size_t SqSize = 0;
+    void* CqPointer = MAP_FAILED;
+    size_t CqSize = 0;
+    io_uring_sqe* Sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t SqesSize = 0;
+
+    unsigned* SqTail = nullptr;
+    unsigned* SqMask = nullptr;
+    unsigned* SqArray = nullptr;
+    unsigned* CqHead = nullptr;
+    unsigned* CqTail = nullptr;
+    unsigned* CqMask = nullptr;
+    io_uring_cqe* Cqes = nullptr;
+    unsigned ToSubmit = 0;
+    int Error = 0;
+
+    std::vector<TSlot> Slots;
+    // Buffers of the reads lost in a broken ring, the kernel may still write to them until it is closed
+    std::vector<TFileDataPtr> Abandoned;
+
+    ~TRing() {
+        // Abandoned buffers go after the descriptor is closed, with the rest of the members
+        if (Sqes != MAP_FAILED) {
+            ::munmap(Sqes, SqesSize);
+        }
+        if (CqPointer != MAP_FAILED && CqPointer != SqPointer) {
+            ::munmap(CqPointer, CqSize);
+        }
+        if (SqPointer != MAP_FAILED) {
+            ::munmap(SqPointer, SqSize);
+        }
+        if (Descriptor != -1) {
+            ::close(Descriptor);
+        }
+    }
+
+    bool Init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        Descriptor = ::syscall(__NR_io_uring_setup, entries, &params);
+        if (Descriptor < 0) {
+            Descriptor = -1;
+            return false;
+        }
+        if (!IsSupported(IORING_OP_OPENAT) || !IsSupported(IORING_OP_READ)) {
+            return false;
+        }
+        SqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        CqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool isSingleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (isSingleMap) {
+            SqSize = CqSize = std::max(SqSize, CqSize);
+        }
+        SqPointer = ::mmap(nullptr, SqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Descriptor, IORING_OFF_SQ_RING);
+        if (SqPointer == MAP_FAILED) {
+            return false;
+        }
+        CqPointer = isSingleMap ? SqPointer
+            : ::mmap(nullptr, CqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Descriptor, IORING_OFF_CQ_RING);
+        if (CqPointer == MAP_FAILED) {
+            return false;
+        }
+        SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        Sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Descriptor, IORING_OFF_SQES));
+        if (Sqes == MAP_FAILED) {
+            return false;
+        }
+        char* sq = static_cast<char*>(SqPointer);
+        SqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        SqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        SqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(CqPointer);
+        CqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        CqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        CqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        Cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        // Every slot has at most one operation in flight, so the rings never overflow
+        Slots.resize(params.sq_entries);
+        return true;
+    }
+
+    bool IsSupported(unsigned operation) const {
+        const size_t opsCount = 256;
+        std::vector<char> buffer(sizeof(io_uring_probe) + opsCount * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (::syscall(__NR_io_uring_register, Descriptor, IORING_REGISTER_PROBE, probe, opsCount) < 0) {
+            return false;
+        }
+        return operation <= probe->last_op && (probe->ops[operation].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    io_uring_sqe* GetSqe(size_t slot) {
+        const unsigned tail = *SqTail;
+        const unsigned index = tail & *SqMask;
+        io_uring_sqe* sqe = &Sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->user_data = slot;
+        SqArray[index] = index;
+        __atomic_store_n(SqTail, tail + 1, __ATOMIC_RELEASE);
+        ToSubmit++;
+        return sqe;
+    }
+
+    void PrepareOpen(size_t slot) {
+        io_uring_sqe* sqe = GetSqe(slot);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(Slots[slot].Request.FileName.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    }
+
+    void PrepareRead(size_t slot) {
+        TSlot& state = Slots[slot];
+        io_uring_sqe* sqe = GetSqe(slot);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = state.Descriptor;
+        sqe->addr = reinterpret_cast<uint64_t>(state.Data->Buffer.get() + state.Offset);
+        sqe->len = std::min<size_t>(state.Data->Length - state.Offset, 1U << 30);
+        sqe->off = state.Offset;
+    }
+
+    // Submits everything prepared and waits for at least minComplete completions.
+    // False if the ring is broken, the requests in it are lost then.
+    bool Enter(unsigned minComplete) {
+        while (true) {
+            const unsigned flags = minComplete != 0 ? IORING_ENTER_GETEVENTS : 0;
+            const long submitted = ::syscall(__NR_io_uring_enter, Descriptor, ToSubmit, minComplete, flags, nullptr, 0);
+            if (submitted < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EBUSY) {
+                    // The kernel is short of resources or the completions have to be reaped first
+                    if (HasCompletions()) {
+                        return true;
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    continue;
+                }
+                Error = errno;
+                return false;
+            }
+            ToSubmit -= std::min<unsigned>(ToSubmit, submitted);
+            return true;
+        }
+    }
+
+    bool HasCompletions() const {
+        return *CqHead != __atomic_load_n(CqTail, __ATOMIC_ACQUIRE);
+    }
+
+    bool PopCompletion(uint64_t& slot, int& result) {
+        const unsigned head = *CqHead;
+        if (head == __atomic_load_n(CqTail, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        const io_uring_cqe& cqe = Cqes[head & *CqMask];
+        slot = cqe.user_data;
+        result = cqe.res;
+        __atomic_store_n(CqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+};
+
+#else
+
+struct TFileReader::TRing {
+};
+
+#endif
+
+TFileReader::TFileReader(EReadMethod method, size_t maxBytesInFlight, size_t queueDepth, size_t maxFileBytes)
+    : Method(method == RM_IO_URING ? RM_IO_URING : RM_PREAD)
+    , QueueDepth(std::max<size_t>(queueDepth, 1))
+    , MaxFileBytes(maxFileBytes)
+    , Budget(std::make_shared<TReadBudget>(maxBytesInFlight))
+    , BytesRead(0)
+{
+#ifdef HAVE_IO_URING
+    if (Method == RM_IO_URING) {
+        Ring.reset(new TRing());
+        if (!Ring->Init(QueueDepth)) {
+            Ring.reset();
+            Method = RM_PREAD;
+        }
+    }
+#else
+    Method = RM_PREAD;
+#endif
+    if (Method == RM_IO_URING) {
+        Threads.emplace_back([this] {
+            bool isStopped = false;
+            try {
+                isStopped = RunIoUring();
+            } catch (...) {
+                SetError(std::current_exception());
+            }
+            if (!isStopped) {
+                AbandonRing();
+                RunPread();
+            }
+        });
+    } else {
+        // Blocking reads keep as many requests in flight as there are threads
+        const size_t threadsCount = std::min<size_t>(QueueDepth, 16);
+        for (size_t i = 0; i < threadsCount; i++) {
+            Threads.emplace_back([this] { RunPread(); });
+        }
+    }
+}
+
+TFileReader::~TFileReader() {
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        IsStopping = true;
+    }
+    Condition.notify_all();
+    for (std::thread& thread : Threads) {
+        thread.join();
+    }
+}
+
+void TFileReader::Read(const std::string& fileName, TFileReadCallback onRead) {
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        if (!IsStarted) {
+            IsStarted = true;
+            StartTime = std::chrono::steady_clock::now();
+        }
+        Requests.push_back({fileName, std::move(onRead)});
+        PendingCount++;
+    }
+    Condition.notify_one();
+}
+
+void TFileReader::Finish() {
+    std::unique_lock<std::mutex> lock(Mutex);
+    FinishCondition.wait(lock, [this] { return PendingCount == 0; });
+    if (IsStarted) {
+        ReadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - StartTime).count();
+    }
+    if (Error) {
+        std::exception_ptr error = Error;
+        Error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void TFileReader::SetError(std::exception_ptr error) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (!Error) {
+        Error = error;
+    }
+}
+
+size_t TFileReader::GetReadSize(size_t fileSize) const {
+    return MaxFileBytes != 0 ? std::min(fileSize, MaxFileBytes) : fileSize;
+}
+
+bool TFileReader::PopRequest(TRequest& request, bool wait) {
+    std::unique_lock<std::mutex> lock(Mutex);
+    if (wait) {
+        Condition.wait(lock, [this] { return IsStopping || !Requests.empty(); });
+    }
+    if (Requests.empty()) {
+        return false;
+    }
+    request = std::move(Requests.front());
+    Requests.pop_front();
+    return true;
+}
+
+void TFileReader::Complete(TRequest& request, TFileDataPtr data) {
+    if (data->IsOk) {
+        BytesRead += data->Length;
+    }
+    // The request is completed even if the callback throws, Finish rethrows the error
+    try {
+        request.OnRead(std::move(data));
+    } catch (...) {
+        SetError(std::current_exception());
+    }
+    request.OnRead = nullptr;
+    bool isFinished = false;
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        isFinished = --PendingCount == 0;
+    }
+    if (isFinished) {
+        FinishCondition.notify_all();
+    }
+}
+
+void TFileReader::RunPread() {
+    TRequest request;
+    while (PopRequest(request, /* wait = */ true)) {
+        Complete(request, TryReadWithPread(request.FileName));
+    }
+}
+
+TFileDataPtr TFileReader::TryReadWithPread(const std::string& fileName) {
+    try {
+        return ReadWithPread(fileName);
+    } catch (...) {
+        SetError(std::current_exception());
+        return TFileDataPtr(new TFileData(fileName, Budget));
+    }
+}
+
+TFileDataPtr TFileReader::ReadWithPread(const std::string& fileName) {
+    TFileDataPtr data(new TFileData(fileName, Budget));
+    const int descriptor = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (descriptor == -1) {
+        return data;
+    }
+    struct stat fileStat;
+    if (::fstat(descriptor, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        ::close(descriptor);
+        return data;
+    }
+    const size_t size = GetReadSize(static_cast<size_t>(fileStat.st_size));
+    Budget->Acquire(size);
+    data->BudgetBytes = size;
+    data->Buffer.reset(new char[size]);
+    size_t offset = 0;
+    while (offset < size) {
+        const ssize_t count = ::pread(descriptor, data->Buffer.get() + offset, size - offset, offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            ::close(descriptor);
+            return data;
+        }
+        if (count == 0) {
+            // The file was truncated since fstat
+            break;
+        }
+        offset += count;
+    }
+    ::close(descriptor);
+    data->Length = offset;
+    data->IsOk = true;
+    return data;
+}
+
+#ifdef HAVE_IO_URING
+
+bool TFileReader::RunIoUring() {
+    TRing& ring = *Ring;
+    std::vector<size_t> freeSlots;
+    for (size_t slot = ring.Slots.size(); slot > 0; slot--) {
+        freeSlots.push_back(slot - 1);
+    }
+    std::deque<size_t> waitingForBudget;
+    size_t inFlightCount = 0;
+
+    auto finish = [&](size_t slot) {
+        TRing::TSlot& state = ring.Slots[slot];
+        if (state.Descriptor != -1) {
+            ::close(state.Descriptor);
+        }
+        TFileDataPtr data = std::move(state.Data);
+        TRequest request = std::move(state.Request);
+        state = TRing::TSlot();
+        freeSlots.push_back(slot);
+        Complete(request, std::move(data));
+    };
+    auto startRead = [&](size_t slot) {
+        TRing::TSlot& state = ring.Slots[slot];
+        state.Data->BudgetBytes = state.Data->Length;
+        state.Data->Buffer.reset(new char[state.Data->Length]);
+        if (state.Data->Length == 0) {
+            state.Data->IsOk = true;
+            finish(slot);
+            return;
+        }
+        ring.PrepareRead(slot);
+        inFlightCount++;
+    };
+    auto onOpened = [&](size_t slot, int result) {
+        TRing::TSlot& state = ring.Slots[slot];
+        state.Data.reset(new TFileData(state.Request.FileName, Budget));
+        if (result < 0) {
+            finish(slot);
+            return;
+        }
+        state.Descriptor = result;
+        state.IsOpened = true;
+        // The inode is already in memory after open, fstat does not touch the disk
+        struct stat fileStat;
+        if (::fstat(state.Descriptor, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+            finish(slot);
+            return;
+        }
+        state.Data->Length = GetReadSize(static_cast<size_t>(fileStat.st_size));
+        waitingForBudget.push_back(slot);
+    };
+    auto onRead = [&](size_t slot, int result) {
+        TRing::TSlot& state = ring.Slots[slot];
+        if (result == -EINTR || result == -EAGAIN) {
+            ring.PrepareRead(slot);
+            inFlightCount++;
+            return;
+        }
+        if (result < 0) {
+            finish(slot);
+            return;
+        }
+        state.Offset += result;
+        if (result == 0 || state.Offset == state.Data->Length) {
+            state.Data->Length = state.Offset;
+            state.Data->IsOk = true;
+            finish(slot);
+            return;
+        }
+        ring.PrepareRead(slot);
+        inFlightCount++;
+    };
+
+    while (true) {
+        TRequest request;
+        while (!freeSlots.empty() && PopRequest(request, /* wait = */ false)) {
+            const size_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            ring.Slots[slot].Request = std::move(request);
+            ring.PrepareOpen(slot);
+            inFlightCount++;
+        }
+        while (!waitingForBudget.empty()) {
+            const size_t slot = waitingForBudget.front();
+            if (!Budget->TryAcquire(ring.Slots[slot].Data->Length)) {
+                break;
+            }
+            waitingForBudget.pop_front();
+            startRead(slot);
+        }
+
+        if (inFlightCount != 0) {
+            if (!ring.Enter(/* minComplete = */ 1)) {
+                return false;
+            }
+        } else if (!waitingForBudget.empty()) {
+            // Nothing to wait for on the ring, only parsing workers can free the budget
+            const size_t slot = waitingForBudget.front();
+            waitingForBudget.pop_front();
+            Budget->Acquire(ring.Slots[slot].Data->Length);
+            startRead(slot);
+            continue;
+        } else if (freeSlots.size() == ring.Slots.size()) {
+            std::unique_lock<std::mutex> lock(Mutex);
+            Condition.wait(lock, [this] { return IsStopping || !Requests.empty(); });
+            if (IsStopping && Requests.empty()) {
+                return true;
+            }
+            continue;
+        }
+
+        uint64_t slot = 0;
+        int result = 0;
+        while (ring.PopCompletion(slot, result)) {
+            inFlightCount--;
+            if (!ring.Slots[slot].IsOpened) {
+                onOpened(slot, result);
+            } else {
+                onRead(slot, result);
+            }
+        }
+    }
+}
+
+void TFileReader::AbandonRing() {
+    TRing& ring = *Ring;
+    {
+        std::unique_lock<std::mutex> lock(Mutex);
+        FallbackReason = ring.Error != 0 ? std::strerror(ring.Error) : "reader thread failed";
+    }
+    Method = RM_PREAD;
+    // Requests of the ring are read again, their buffers stay with the ring
+    for (TRing::TSlot& state : ring.Slots) {
+        if (!state.Request.OnRead) {
+            continue;
+        }
+        if (state.Data) {
+            if (state.Data->BudgetBytes != 0) {
+                Budget->Release(state.Data->BudgetBytes);
+                state.Data->BudgetBytes = 0;
+            }
+            ring.Abandoned.push_back(std::move(state.Data));
+        }
+        if (state.Descriptor != -1) {
+            ::close(state.Descriptor);
+        }
+        TRequest request = std::move(state.Request);
+        state = TRing::TSlot();
+        Complete(request, TryReadWithPread(request.FileName));
+    }
+}
+
+#else
+
+bool TFileReader::RunIoUring() {
+    return true;
+}
+
+void TFileReader::AbandonRing() {
+}
+
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum EReadMethod {
+    // Dedicated reader stage on io_uring, RM_PREAD if the kernel can't do it
+    RM_IO_URING = 0,
+    // Dedicated reader stage on blocking pread threads
+    RM_PREAD = 1,
+    // No reader stage, every parsing task maps its own file
+    RM_MMAP = 2
+};
+
+// Bytes held by the TFileData objects that are still alive.
+// A file larger than the whole budget is let through when nothing else is held.
+class TReadBudget {
+public:
+    explicit TReadBudget(size_t maxBytes);
+
+    bool TryAcquire(size_t bytes);
+    void Acquire(size_t bytes);
+    void Release(size_t bytes);
+
+private:
+    std::mutex Mutex;
+    std::condition_variable Condition;
+    const size_t MaxBytes;
+    size_t Bytes = 0;
+};
+
+// Whole file read by TFileReader. Its size is counted against the reader budget
+// until the object is destroyed.
+class TFileData {
+public:
+    TFileData(const TFileData&) = delete;
+    TFileData& operator=(const TFileData&) = delete;
+    ~TFileData();
+
+    const std::string& GetFileName() const { return FileName; }
+    bool IsRead() const { return IsOk; }
+    const char* Data() const { return Buffer.get(); }
+    size_t Size() const { return Length; }
+
+private:
+    friend class TFileReader;
+    friend class TTarReader;
+    TFileData(const std::string& fileName, std::shared_ptr<TReadBudget> budget);
+
+private:
+    std::string FileName;
+    std::shared_ptr<TReadBudget> Budget;
+    size_t BudgetBytes = 0;
+    std::unique_ptr<char[]> Buffer;
+    size_t Length = 0;
+    bool IsOk = false;
+};
+
+using TFileDataPtr = std::shared_ptr<TFileData>;
+using TFileReadCallback = std::function<void(TFileDataPtr)>;
+
+// I/O stage that keeps many reads in flight and hands complete files over to
+// callbacks, so that CPU workers never wait on the disk. New reads are not
+// started while the unreleased TFileData objects hold more than maxBytesInFlight.
+// Only the first maxFileBytes of a file are read, zero reads files whole.
+class TFileReader {
+public:
+    TFileReader(
+        EReadMethod method = RM_IO_URING,
+        size_t maxBytesInFlight = 256 << 20,
+        size_t queueDepth = 64,
+        size_t maxFileBytes = 0);
+    TFileReader(const TFileReader&) = delete;
+    TFileReader& operator=(const TFileReader&) = delete;
+    ~TFileReader();
+
+    // The callback is run on a reader thread, it gets an unread TFileData on errors
+    void Read(const std::string& fileName, TFileReadCallback onRead);
+    // Blocks until every requested file is handed over. Rethrows the first exception
+    // of a callback or of a reader thread, the files are handed over all the same.
+    void Finish();
+
+    // RM_PREAD after a fallback from RM_IO_URING
+    EReadMethod GetMethod() const { return Method; }
+    // Why a broken ring fell back to RM_PREAD, empty if it did not. Valid after Finish.
+    const std::string& GetFallbackReason() const { return FallbackReason; }
+    uint64_t GetBytesRead() const { return BytesRead; }
+    // Time from the first request to the last handed over file
+    double GetReadTimeMs() const { return ReadTimeMs; }
+
+private:
+    struct TRequest {
+        std::string FileName;
+        TFileReadCallback OnRead;
+    };
+    struct TRing;
+
+private:
+    size_t GetReadSize(size_t fileSize) const;
+    bool PopRequest(TRequest& request, bool wait);
+    void Complete(TRequest& request, TFileDataPtr data);
+    void SetError(std::exception_ptr error);
+    void RunPread();
+    TFileDataPtr ReadWithPread(const std::string& fileName);
+    // An unread TFileData if reading throws
+    TFileDataPtr TryReadWithPread(const std::string& fileName);
+    // False if the ring broke, its requests are then read again by AbandonRing
+    bool RunIoUring();
+    void AbandonRing();
+
+private:
+    std::atomic<EReadMethod> Method;
+    const size_t QueueDepth;
+    const size_t MaxFileBytes;
+    std::shared_ptr<TReadBudget> Budget;
+    std::unique_ptr<TRing> Ring;
+
+    std::mutex Mutex;
+    std::condition_variable Condition;
+    std::condition_variable FinishCondition;
+    std::deque<TRequest> Requests;
+    size_t PendingCount = 0;
+    bool IsStopping = false;
+    std::chrono::steady_clock::time_point StartTime;
+    bool IsStarted = false;
+    std::exception_ptr Error;
+    std::string FallbackReason;
+
+    std::atomic<uint64_t> BytesRead;
+    double ReadTimeMs = 0.0;
+    std::vector<std::thread> Threads;
+};
@@ -0,0 +1,609 @@
+#include "html_scanner.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Same limit as TINYXML2_MAX_ELEMENT_DEPTH
+const size_t MAX_ELEMENT_DEPTH = 100;
+
+// tinyxml2 relies on isspace/isalpha in the "C" locale
+inline bool IsWhiteSpace(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+}
+
+inline bool IsNameStartChar(char ch) {
+    const unsigned char uch = static_cast<unsigned char>(ch);
+    return uch >= 128 || (uch >= 'a' && uch <= 'z') || (uch >= 'A' && uch <= 'Z') || uch == ':' || uch == '_';
+}
+
+inline bool IsNameChar(char ch) {
+    return IsNameStartChar(ch) || (ch >= '0' && ch <= '9') || ch == '.' || ch == '-';
+}
+
+inline const char* SkipWhiteSpace(const char* p, const char* end) {
+    while (p < end && IsWhiteSpace(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+inline bool StartsWith(const char* p, const char* end, const char* prefix, size_t length) {
+    return static_cast<size_t>(end - p) >= length && std::memcmp(p, prefix, length) == 0;
+}
+
+const char* Find(const char* p, const char* end, const char* pattern, size_t length) {
+    while (p < end) {
+        p = static_cast<const char*>(std::memchr(p, pattern[0], end - p));
+        if (!p) {
+            return nullptr;
+        }
+        if (StartsWith(p, end, pattern, length)) {
+            return p;
+        }
+        ++p;
+    }
+    return nullptr;
+}
+
+const char* ParseName(const char* p, const char* end) {
+    if (p == end || !IsNameStartChar(*p)) {
+        return nullptr;
+    }
+    ++p;
+    while (p < end && IsNameChar(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+// tinyxml2 XMLUtil::ConvertUTF32ToUTF8
+void ConvertUTF32ToUTF8(unsigned long input, char* output, int* length) {
+    const unsigned long BYTE_MASK = 0xBF;
+    const unsigned long BYTE_MARK = 0x80;
+    const unsigned long FIRST_BYTE_MARK[7] = {0x00, 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC};
+
+    if (input < 0x80) {
+        *length = 1;
+    } else if (input < 0x800) {
+        *length = 2;
+    } else if (input < 0x10000) {
+        *length = 3;
+    } else if (input < 0x200000) {
+        *length = 4;
+    } else {
+        *length = 0;
+        return;
+    }
+    for (int i = *length - 1; i > 0; i--) {
+        output[i] = static_cast<char>((input | BYTE_MARK) & BYTE_MASK);
+        input >>= 6;
+    }
+    output[0] = static_cast<char>(input | FIRST_BYTE_MARK[*length]);
+}
+
+// tinyxml2 XMLUtil::GetCharacterRef, bounded by the end of the string instead of a NUL
+const char* ReadCharacterRef(const char* p, const char* end, char* value, int* length) {
+    *length = 0;
+    if (p + 2 >= end) {
+        return p + 1;
+    }
+    unsigned long ucs = 0;
+    ptrdiff_t delta = 0;
+    unsigned mult = 1;
+    if (p[2] == 'x') {
+        const char* q = p + 3;
+        if (q == end) {
+            return nullptr;
+        }
+        q = static_cast<const char*>(std::memchr(q, ';', end - q));
+        if (!q) {
+            return nullptr;
+        }
+        delta = q - p;
+        --q;
+        while (*q != 'x') {
+            unsigned int digit = 0;
+            if (*q >= '0' && *q <= '9') {
+                digit = *q - '0';
+            } else if (*q >= 'a' && *q <= 'f') {
+                digit = *q - 'a' + 10;
+            } else if (*q >= 'A' && *q <= 'F') {
+                digit = *q - 'A' + 10;
+            } else {
+                return nullptr;
+            }
+            const unsigned int digitScaled = mult * digit;
+            ucs += digitScaled;
+            mult *= 16;
+            --q;
+        }
+    } else {
+        const char* q = static_cast<const char*>(std::memchr(p + 2, ';', end - p - 2));
+        if (!q) {
+            return nullptr;
+        }
+        delta = q - p;
+        --q;
+        while (*q != '#') {
+            if (*q < '0' || *q > '9') {
+                return nullptr;
+            }
+            const unsigned int digitScaled = mult * static_cast<unsigned int>(*q - '0');
+            ucs += digitScaled;
+            mult *= 10;
+            --q;
+        }
+    }
+    ConvertUTF32ToUTF8(ucs, value, length);
+    return p + delta + 1;
+}
+
+struct TEntity {
+    const char* Pattern;
+    size_t Length;
+    char Value;
+};
+
+const TEntity ENTITIES[] = {
+    {"quot", 4, '"'},
+    {"amp", 3, '&'},
+    {"apos", 4, '\''},
+    {"lt", 2, '<'},
+    {"gt", 2, '>'}
+};
+
+} // namespace
+
+size_t GetMaxReadBytes(const TDocumentLimits& limits) {
+    return limits.MaxBytes != 0 ? limits.MaxBytes + 1 : 0;
+}
+
+void AppendXmlText(const char* begin, const char* end, bool processEntities, std::string& output) {
+    const size_t base = output.size();
+    bool hasNul = false;
+    const char* p = begin;
+    while (p < end) {
+        if (*p == '\r') {
+            p += (p + 1 < end && p[1] == '\n') ? 2 : 1;
+            output.push_back('\n');
+        } else if (*p == '\n') {
+            p += (p + 1 < end && p[1] == '\r') ? 2 : 1;
+            output.push_back('\n');
+        } else if (processEntities && *p == '&') {
+            if (p + 1 < end && p[1] == '#') {
+                char buffer[10] = {0};
+                int length = 0;
+                const char* adjusted = ReadCharacterRef(p, end, buffer, &length);
+                if (!adjusted) {
+                    output.push_back(*p);
+                    ++p;
+                } else {
+                    hasNul = hasNul || (length == 1 && buffer[0] == 0);
+                    output.append(buffer, length);
+                    p = adjusted;
+                }
+                continue;
+            }
+            bool isFound = false;
+            for (const TEntity& entity : ENTITIES) {
+                if (p + entity.Length + 1 < end
+                    && std::memcmp(p + 1, entity.Pattern, entity.Length) == 0
+                    && p[entity.Length + 1] == ';')
+                {
+                    output.push_back(entity.Value);
+                    p += entity.Length + 2;
+                    isFound = true;
+                    break;
+                }
+            }
+            if (!isFound) {
+                // tinyxml2 decodes in place and only moves its write pointer here,
+                // so it keeps whatever source byte is under that pointer
+                output.push_back(begin[output.size() - base]);
+                ++p;
+            }
+        } else {
+            output.push_back(*p);
+            ++p;
+        }
+    }
+    // Values are handed out as C strings, a decoded &#0; cuts them
+    if (hasNul) {
+        output.resize(output.find('\0', base));
+    }
+}
+
+void TruncateUtf8(std::string& text, size_t maxLength) {
+    if (text.size() <= maxLength) {
+        return;
+    }
+    // Continuation bytes are 10xxxxxx
+    size_t length = maxLength;
+    while (length > 0 && (static_cast<unsigned char>(text[length]) & 0xC0) == 0x80) {
+        length--;
+    }
+    text.resize(length);
+}
+
+size_t CountWords(const std::string& text, size_t start) {
+    size_t count = 0;
+    bool inWord = false;
+    for (size_t i = start; i < text.size(); i++) {
+        const bool isSpace = IsWhiteSpace(text[i]);
+        if (!isSpace && !inWord) {
+            count++;
+        }
+        inWord = !isSpace;
+    }
+    return count;
+}
+
+THtmlScanner::THtmlScanner(bool parseLinks, bool shrinkText, size_t maxWords, const TDocumentLimits& limits)
+    : ParseLinks(parseLinks)
+    , ShrinkText(shrinkText)
+    , MaxWords(maxWords)
+    , Limits(limits)
+{}
+
+bool THtmlScanner::Scan(const char* data, size_t size, THtmlScanResult& result, size_t textPrefixLength) {
+    result = THtmlScanResult();
+    Result = &result;
+    TextPrefixLength = textPrefixLength;
+    Stack.clear();
+    WordCount = 0;
+    ParagraphCount = 0;
+    ParagraphDepth = 0;
+    ParagraphStart = 0;
+    AuthorDepth = 0;
+    HasTime = false;
+    HasAddressLink = false;
+    HasNonDeclaration = false;
+    IsHeadClosed = false;
+    IsArticleClosed = false;
+    IsPausedFlag = false;
+    IsDone = false;
+
+    // tinyxml2 parses a C string, so everything after a NUL is invisible to it
+    const char* p = data;
+    const size_t readSize = (Limits.MaxBytes != 0) ? std::min(size, Limits.MaxBytes) : size;
+    End = data + readSize;
+    if (readSize != 0) {
+        if (const void* nul = std::memchr(data, 0, readSize)) {
+            End = static_cast<const char*>(nul);
+        }
+    }
+    IsCut = End == data + readSize && readSize < size;
+    p = SkipWhiteSpace(p, End);
+    if (StartsWith(p, End, "\xEF\xBB\xBF", 3)) {
+        p += 3;
+    }
+    Position = p;
+    if (p == End) {
+        return false;
+    }
+    result.Text.reserve((End - p) / HTML_BYTES_PER_TEXT_BYTE);
+    return Finish(Run());
+}
+
+bool THtmlScanner::Resume() {
+    IsPausedFlag = false;
+    TextPrefixLength = 0;
+    return Finish(Run());
+}
+
+bool THtmlScanner::Finish(bool isScanned) {
+    if (isScanned || IsPausedFlag || !IsCut) {
+        return isScanned;
+    }
+    // Only the node the cut went through may be unfinished, an error
+    // in a complete tag would fail the whole page as well
+    if (std::memchr(Position, '>', End - Position)) {
+        return false;
+    }
+    if (ParagraphDepth != 0) {
+        Result->Text += '\n';
+        ParagraphDepth = 0;
+    }
+    Result->TruncatedLimits |= 1u << DL_BYTES;
+    IsDone = true;
+    return Result->HasHtml;
+}
+
+bool THtmlScanner::Run() {
+    const char* p = Position;
+    const char* end = End;
+    while (p < end && !IsDone) {
+        if (TextPrefixLength != 0
+            && IsHeadClosed
+            && (Result->Text.size() >= TextPrefixLength || IsArticleClosed))
+        {
+            Position = p;
+            IsPausedFlag = true;
+            return true;
+        }
+        // Start of the node a failure is in, see Finish
+        Position = p;
+        const char* start = p;
+        p = SkipWhiteSpace(p, end);
+        if (p == end) {
+            break;
+        }
+        if (StartsWith(p, end, "<?", 2)) {
+            const char* close = Find(p + 2, end, "?>", 2);
+            // Declarations are allowed only at the document level before anything else
+            if (!close || !Stack.empty() || HasNonDeclaration) {
+                return false;
+            }
+            p = close + 2;
+        } else if (StartsWith(p, end, "<!--", 4)) {
+            const char* close = Find(p + 4, end, "-->", 3);
+            if (!close) {
+                return false;
+            }
+            OnNode();
+            p = close + 3;
+        } else if (StartsWith(p, end, "<![CDATA[", 9)) {
+            const char* close = Find(p + 9, end, "]]>", 3);
+            if (!close) {
+                return false;
+            }
+            OnText(p + 9, close, /* isCData = */ true);
+            p = close + 3;
+        } else if (StartsWith(p, end, "<!", 2)) {
+            const char* close = Find(p + 2, end, ">", 1);
+            if (!close) {
+                return false;
+            }
+            OnNode();
+            p = close + 1;
+        } else if (*p == '<') {
+            ++p;
+            if (!ParseTag(p, end)) {
+                return false;
+            }
+        } else {
+            // Text keeps its leading whitespace and must be followed by a tag
+            const char* close = static_cast<const char*>(std::memchr(p, '<', end - p));
+            if (!close || close + 1 == end) {
+                return false;
+            }
+            OnText(start, close, /* isCData = */ false);
+            p = close;
+        }
+    }
+    Position = p;
+    return Stack.empty();
+}
+
+bool THtmlScanner::ParseTag(const char*& p, const char* end) {
+    p = SkipWhiteSpace(p, end);
+    bool isClosing = false;
+    if (p < end && *p == '/') {
+        isClosing = true;
+        ++p;
+    }
+    const char* nameEnd = ParseName(p, end);
+    if (!nameEnd) {
+        return false;
+    }
+    const TRange name = {p, nameEnd};
+    p = nameEnd;
+
+    Attributes.clear();
+    bool isClosed = false;
+    while (true) {
+        p = SkipWhiteSpace(p, end);
+        if (p == end) {
+            return false;
+        }
+        if (IsNameStartChar(*p)) {
+            TAttribute attribute;
+            attribute.Name = {p, ParseName(p, end)};
+            p = SkipWhiteSpace(attribute.Name.End, end);
+            if (p == end || *p != '=') {
+                return false;
+            }
+            p = SkipWhiteSpace(p + 1, end);
+            if (p == end || (*p != '"' && *p != '\'')) {
+                return false;
+            }
+            const char* close = static_cast<const char*>(std::memchr(p + 1, *p, end - p - 1));
+            if (!close) {
+                return false;
+            }
+            attribute.Value = {p + 1, close};
+            const size_t nameLength = attribute.Name.End - attribute.Name.Begin;
+            for (const TAttribute& other : Attributes) {
+                if (static_cast<size_t>(other.Name.End - other.Name.Begin) == nameLength
+                    && std::memcmp(other.Name.Begin, attribute.Name.Begin, nameLength) == 0)
+                {
+                    return false;
+                }
+            }
+            Attributes.push_back(attribute);
+            p = close + 1;
+        } else if (*p == '>') {
+            ++p;
+            break;
+        } else if (*p == '/' && p + 1 < end && p[1] == '>') {
+            // Even "</name/>" ends up as an empty element in tinyxml2
+            isClosed = true;
+            p += 2;
+            break;
+        } else {
+            return false;
+        }
+    }
+
+    if (isClosed) {
+        OnOpen(name);
+        OnClose();
+        return true;
+    }
+    if (isClosing) {
+        if (Stack.empty()) {
+            // tinyxml2 silently stops at an end tag on the document level
+            IsDone = true;
+            return true;
+        }
+        const TRange& openName = Stack.back().Name;
+        if (openName.End - openName.Begin != name.End - name.Begin
+            || std::memcmp(openName.Begin, name.Begin, name.End - name.Begin) != 0)
+        {
+            return false;
+        }
+        OnClose();
+        return true;
+    }
+    if (p == end) {
+        return false;
+    }
+    OnOpen(name);
+    return Stack.size() + 1 < MAX_ELEMENT_DEPTH;
+}
+
+void THtmlScanner::OnOpen(const TRange& name) {
+    OnNode();
+    auto isNamed = [&name](const char* expected) {
+        const size_t length = std::strlen(expected);
+        return static_cast<size_t>(name.End - name.Begin) == length && std::memcmp(name.Begin, expected, length) == 0;
+    };
+    ERole role = R_NONE;
+    const ERole parentRole = Stack.empty() ? R_NONE : Stack.back().Role;
+    if (Stack.empty()) {
+        if (!Result->HasHtml && isNamed("html")) {
+            Result->HasHtml = true;
+            role = R_HTML;
+        }
+    } else if (parentRole == R_HTML) {
+        if (!Result->HasHead && isNamed("head")) {
+            Result->HasHead = true;
+            role = R_HEAD;
+        } else if (!Result->HasBody && isNamed("body")) {
+            Result->HasBody = true;
+            role = R_BODY;
+        }
+    } else if (parentRole == R_HEAD) {
+        if (isNamed("meta")) {
+            Result->HasMeta = true;
+            const TAttribute* property = FindAttribute("property");
+            const TAttribute* content = FindAttribute("content");
+            if (property && content) {
+                Result->Metas.emplace_back();
+                THtmlScanResult::TMeta& meta = Result->Metas.back();
+                AppendXmlText(property->Value.Begin, property->Value.End, true, meta.Property);
+                AppendXmlText(content->Value.Begin, content->Value.End, true, meta.Content);
+            }
+        }
+    } else if (parentRole == R_BODY) {
+        if (!Result->HasArticle && isNamed("article")) {
+            Result->HasArticle = true;
+            role = R_ARTICLE;
+        }
+    } else if (parentRole == R_ARTICLE) {
+        if (isNamed("p")) {
+            const bool isTextFull = Result->TruncatedLimits & (1u << DL_TEXT_LENGTH);
+            if (!isTextFull && (!ShrinkText || WordCount < MaxWords)) {
+                if (Limits.MaxParagraphs != 0 && ParagraphCount == Limits.MaxParagraphs) {
+                    Result->TruncatedLimits |= 1u << DL_PARAGRAPHS;
+                } else {
+                    role = R_PARAGRAPH;
+                    ParagraphDepth = Stack.size() + 1;
+                    ParagraphStart = Result->Text.size();
+                    ParagraphCount++;
+                }
+            }
+        } else if (!Result->HasAddress && isNamed("address")) {
+            Result->HasAddress = true;
+            role = R_ADDRESS;
+        }
+    } else if (parentRole == R_ADDRESS) {
+        if (!HasTime && isNamed("time")) {
+            HasTime = true;
+            if (const TAttribute* datetime = FindAttribute("datetime")) {
+                Result->Time = std::string();
+                AppendXmlText(datetime->Value.Begin, datetime->Value.End, true, *Result->Time);
+            }
+        } else if (!HasAddressLink && isNamed("a")) {
+            HasAddressLink = true;
+            if (const TAttribute* rel = FindAttribute("rel")) {
+                std::string value;
+                AppendXmlText(rel->Value.Begin, rel->Value.End, true, value);
+                if (value == "author") {
+                    role = R_AUTHOR;
+                    AuthorDepth = Stack.size() + 1;
+                }
+            }
+        }
+    }
+    if (ParseLinks && ParagraphDepth != 0 && role != R_PARAGRAPH && isNamed("a")) {
+        if (const TAttribute* href = FindAttribute("href")) {
+            if (Limits.MaxOutLinks != 0 && Result->OutLinks.size() == Limits.MaxOutLinks) {
+                Result->TruncatedLimits |= 1u << DL_OUT_LINKS;
+            } else {
+                Result->OutLinks.emplace_back();
+                AppendXmlText(href->Value.Begin, href->Value.End, true, Result->OutLinks.back());
+            }
+        }
+    }
+    Stack.push_back({name, role});
+}
+
+void THtmlScanner::OnClose() {
+    const ERole role = Stack.back().Role;
+    Stack.pop_back();
+    if (role == R_PARAGRAPH) {
+        if (ShrinkText) {
+            WordCount += CountWords(Result->Text, ParagraphStart);
+        }
+        Result->Text += '\n';
+        ParagraphDepth = 0;
+    } else if (role == R_AUTHOR) {
+        AuthorDepth = 0;
+    } else if (role == R_HEAD) {
+        IsHeadClosed = true;
+    } else if (role == R_ARTICLE) {
+        IsArticleClosed = true;
+    } else if (role == R_HTML) {
+        // Nothing after the first <html> can change the result
+        IsDone = true;
+    }
+}
+
+void THtmlScanner::OnText(const char* begin, const char* end, bool isCData) {
+    if (ParagraphDepth != 0 && !(Result->TruncatedLimits & (1u << DL_TEXT_LENGTH))) {
+        AppendXmlText(begin, end, !isCData, Result->Text);
+        if (Limits.MaxTextLength != 0 && Result->Text.size() > Limits.MaxTextLength) {
+            TruncateUtf8(Result->Text, Limits.MaxTextLength);
+            Result->TruncatedLimits |= 1u << DL_TEXT_LENGTH;
+        }
+    }
+    if (AuthorDepth != 0 && AuthorDepth == Stack.size()) {
+        Result->Author = std::string();
+        AppendXmlText(begin, end, !isCData, *Result->Author);
+    }
+    OnNode();
+}
+
+void THtmlScanner::OnNode() {
+    if (Stack.empty()) {
+        HasNonDeclaration = true;
+    } else if (AuthorDepth == Stack.size()) {
+        // Only the first child of the author link may hold its text
+        AuthorDepth = 0;
+    }
+}
+
+const THtmlScanner::TAttribute* THtmlScanner::FindAttribute(const char* name) const {
+    const size_t length = std::strlen(name);
+    for (const TAttribute& attribute : Attributes) {
+        if (static_cast<size_t>(attribute.Name.End - attribute.Name.Begin) == length
+            && std::memcmp(attribute.Name.Begin, name, length) == 0)
+        {
+            return &attribute;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+// A news page has at least 2 bytes of HTML per byte of article text, so the
+// text buffer reserved by this ratio rarely has to grow
+const size_t HTML_BYTES_PER_TEXT_BYTE = 2;
+
+// Budgets of a single page, the parsing stops collecting whatever went over one.
+// Zero means no limit.
+struct TDocumentLimits {
+    // Bytes of HTML read, a page cut by it is accepted if the cut is the only problem
+    size_t MaxBytes = 0;
+    // Article paragraphs collected
+    size_t MaxParagraphs = 0;
+    // Bytes of the text, it is cut at a character boundary
+    size_t MaxTextLength = 0;
+    size_t MaxOutLinks = 0;
+};
+
+// Bytes of a file worth reading for the limits, zero for the whole file. The byte past
+// MaxBytes is read too, it tells the scanner that the page was cut.
+size_t GetMaxReadBytes(const TDocumentLimits& limits);
+
+// Limits a page can go over, TDocument::TruncatedLimits has a bit for each of them
+enum EDocumentLimit {
+    DL_BYTES = 0,
+    DL_PARAGRAPHS,
+    DL_TEXT_LENGTH,
+    DL_OUT_LINKS,
+
+    DL_COUNT
+};
+
+// Everything TDocument::FromHtml reads from a page, already decoded
+struct THtmlScanResult {
+    struct TMeta {
+        std::string Property;
+        std::string Content;
+    };
+
+    bool HasHtml = false;
+    bool HasHead = false;
+    bool HasMeta = false;
+    bool HasBody = false;
+    bool HasArticle = false;
+    bool HasAddress = false;
+
+    // <meta> children of the head with both property and content
+    std::vector<TMeta> Metas;
+    // Full text of the article <p> children, one line per paragraph
+    std::string Text;
+    // href of every <a> inside the collected paragraphs
+    std::vector<std::string> OutLinks;
+    // datetime of the first <time> in the address
+    boost::optional<std::string> Time;
+    // Text of the first <a rel="author"> in the address
+    boost::optional<std::string> Author;
+    // Bits of EDocumentLimit for the limits the page went over
+    uint32_t TruncatedLimits = 0;
+};
+
+// Single pass scanner over a raw HTML buffer.
+// It accepts and rejects exactly the inputs tinyxml2 does and yields the same
+// strings as walking the tinyxml2 DOM, but never builds the tree.
+class THtmlScanner {
+public:
+    THtmlScanner(
+        bool parseLinks = false,
+        bool shrinkText = false,
+        size_t maxWords = 200,
+        const TDocumentLimits& limits = TDocumentLimits());
+
+    // Returns false if tinyxml2 would fail before the first <html> is closed.
+    // With a nonzero textPrefixLength the scan pauses as soon as the head is closed
+    // and the text has that many bytes, so a caller can look at them first.
+    bool Scan(const char* data, size_t size, THtmlScanResult& result, size_t textPrefixLength = 0);
+    // Finishes a paused scan
+    bool Resume();
+
+    bool IsPaused() const { return IsPausedFlag; }
+    size_t GetRemainingSize() const { return End - Position; }
+
+private:
+    enum ERole {
+        R_NONE = 0,
+        R_HTML,
+        R_HEAD,
+        R_BODY,
+        R_ARTICLE,
+        R_PARAGRAPH,
+        R_ADDRESS,
+        R_AUTHOR
+    };
+
+    struct TRange {
+        const char* Begin;
+        const char* End;
+    };
+
+    struct TAttribute {
+        TRange Name;
+        TRange Value;
+    };
+
+    struct TElement {
+        TRange Name;
+        ERole Role;
+    };
+
+private:
+    bool Run();
+    // Ends a scan that ran into the byte limit
+    bool Finish(bool isScanned);
+    bool ParseTag(const char*& p, const char* end);
+    void OnOpen(const TRange& name);
+    void OnClose();
+    void OnText(const char* begin, const char* end, bool isCData);
+    void OnNode();
+    const TAttribute* FindAttribute(const char* name) const;
+
+private:
+    const bool ParseLinks;
+    const bool ShrinkText;
+    const size_t MaxWords;
+    const TDocumentLimits Limits;
+
+    THtmlScanResult* Result = nullptr;
+    const char* Position = nullptr;
+    const char* End = nullptr;
+    size_t TextPrefixLength = 0;
+    std::vector<TElement> Stack;
+    std::vector<TAttribute> Attributes;
+    size_t WordCount = 0;
+    size_t ParagraphCount = 0;
+    size_t ParagraphDepth = 0;
+    size_t ParagraphStart = 0;
+    size_t AuthorDepth = 0;
+    bool HasTime = false;
+    bool HasAddressLink = false;
+    bool HasNonDeclaration = false;
+    bool IsHeadClosed = false;
+    bool IsArticleClosed = false;
+    bool IsPausedFlag = false;
+    bool IsDone = false;
+    bool IsCut = false;
+};
+
+// Appends a text or attribute value the way tinyxml2 StrPair::GetStr decodes it
+void AppendXmlText(const char* begin, const char* end, bool processEntities, std::string& output);
+
+// Cuts the text to at most maxLength bytes without splitting a UTF-8 character
+void TruncateUtf8(std::string& text, size_t maxLength);
+
+// Words of the text from the start offset, separated by the whitespace tinyxml2 knows
+size_t CountWords(const std::string& text, size_t start);
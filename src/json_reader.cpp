@@ -0,0 +1,159 @@
+#include "json_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace {
+
+// Builds elements of the top-level array like the DOM parser does
+class TJsonArrayHandler : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit TJsonArrayHandler(const TJsonElementCallback& onElement)
+        : OnElement(onElement)
+    {}
+
+    bool null() override {
+        return AddValue(nullptr);
+    }
+    bool boolean(bool value) override {
+        return AddValue(value);
+    }
+    bool number_integer(number_integer_t value) override {
+        return AddValue(value);
+    }
+    bool number_unsigned(number_unsigned_t value) override {
+        return AddValue(value);
+    }
+    bool number_float(number_float_t value, const string_t&) override {
+        return AddValue(value);
+    }
+    bool string(string_t& value) override {
+        return AddValue(std::move(value));
+    }
+    bool key(string_t& value) override {
+        Key = std::move(value);
+        return true;
+    }
+    bool start_object(std::size_t) override {
+        return StartContainer(nlohmann::json::object());
+    }
+    bool end_object() override {
+        return EndContainer();
+    }
+    bool start_array(std::size_t) override {
+        if (!IsInArray) {
+            IsInArray = true;
+            return true;
+        }
+        return StartContainer(nlohmann::json::array());
+    }
+    bool end_array() override {
+        if (Stack.empty()) {
+            IsInArray = false;
+            return true;
+        }
+        return EndContainer();
+    }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        throw std::runtime_error(ex.what());
+    }
+
+private:
+    // Returns the added value
+    nlohmann::json* Add(nlohmann::json&& value) {
+        if (!IsInArray) {
+            throw std::runtime_error("JSON array expected");
+        }
+        if (Stack.empty()) {
+            Element = std::move(value);
+            return &Element;
+        }
+        nlohmann::json& parent = *Stack.back();
+        if (parent.is_array()) {
+            parent.push_back(std::move(value));
+            return &parent.back();
+        }
+        nlohmann::json& child = parent[Key];
+        child = std::move(value);
+        return &child;
+    }
+
+    bool AddValue(nlohmann::json&& value) {
+        Add(std::move(value));
+        if (Stack.empty()) {
+            OnElement(std::move(Element));
+        }
+        return true;
+    }
+
+    // Parents never grow while their last child is open, so the pointers stay valid
+    bool StartContainer(nlohmann::json&& container) {
+        Stack.push_back(Add(std::move(container)));
+        return true;
+    }
+
+    bool EndContainer() {
+        Stack.pop_back();
+        if (Stack.empty()) {
+            OnElement(std::move(Element));
+        }
+        return true;
+    }
+
+private:
+    const TJsonElementCallback& OnElement;
+    bool IsInArray = false;
+    nlohmann::json Element;
+    std::vector<nlohmann::json*> Stack;
+    std::string Key;
+};
+
+} // namespace
+
+bool IsJsonLines(const std::string& fileName) {
+    return boost::algorithm::ends_with(fileName, ".jsonl");
+}
+
+void ReadJsonArray(std::istream& stream, const TJsonElementCallback& onElement) {
+    TJsonArrayHandler handler(onElement);
+    nlohmann::json::sax_parse(stream, &handler);
+}
+
+std::vector<std::pair<size_t, size_t>> SplitByLines(const char* data, size_t size, size_t chunksCount) {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    const size_t chunkSize = size / std::max<size_t>(chunksCount, 1) + 1;
+    size_t begin = 0;
+    while (begin < size) {
+        size_t end = std::min(begin + chunkSize, size);
+        const void* newline = std::memchr(data + end - 1, '\n', size - end + 1);
+        end = newline ? static_cast<const char*>(newline) - data + 1 : size;
+        chunks.emplace_back(begin, end);
+        begin = end;
+    }
+    return chunks;
+}
+
+void ReadJsonLines(const char* begin, const char* end, const TJsonElementCallback& onElement) {
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        const char* lineEnd = newline ? newline : end;
+        const bool isBlank = std::all_of(begin, lineEnd, [](char ch) {
+            return ch == ' ' || ch == '\t' || ch == '\r';
+        });
+        if (!isBlank) {
+            nlohmann::json element;
+            try {
+                element = nlohmann::json::parse(begin, lineEnd);
+            } catch (const nlohmann::json::parse_error& ex) {
+                throw std::runtime_error(ex.what());
+            }
+            onElement(std::move(element));
+        }
+        begin = newline ? newline + 1 : end;
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <functional>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nlohmann_json/json.hpp>
+
+// Checks the extension: .jsonl
+bool IsJsonLines(const std::string& fileName);
+
+// Called with every element of a top-level JSON array
+using TJsonElementCallback = std::function<void(nlohmann::json&& element)>;
+
+// SAX parsing of a JSON array: every element is handed over as soon as it is read,
+// so the whole array is never held in memory. Throws std::runtime_error on bad input.
+void ReadJsonArray(std::istream& stream, const TJsonElementCallback& onElement);
+
+// Byte ranges [first, second) that cover the data and end right after a newline,
+// except for the last one. There are at most chunksCount of them.
+std::vector<std::pair<size_t, size_t>> SplitByLines(const char* data, size_t size, size_t chunksCount);
+
+// JSON Lines: every line that is not blank is parsed as a separate JSON value.
+// Throws std::runtime_error on bad input.
+void ReadJsonLines(const char* begin, const char* end, const TJsonElementCallback& onElement);
@@ -1,16 +1,73 @@
 #include "agency_rating.h"
 #include "annotate.h"
 #include "clustering/slink.h"
+#include "daemon.h"
 #include "document.h"
 #include "rank.h"
 #include "summarize.h"
+#include "tar_reader.h"
+#include "thread_pool.h"
 #include "timer.h"
 #include "util.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 
+#include <fstream>
+#include <sstream>
+
 namespace po = boost::program_options;
 
+// Stages and document fields every output mode needs
+EAnnotationLevel GetAnnotationLevel(const std::string& mode) {
+    // Languages need the not-news filter too
+    if (mode == "languages" || mode == "news" || mode == "sites" || mode == "categories") {
+        return AL_CATEGORY;
+    }
+    if (mode == "json") {
+        return AL_TEXT;
+    }
+    return AL_FULL;
+}
+
+bool IsKnownMode(const std::string& mode) {
+    std::vector<std::string> modes = {
+        "languages",
+        "news",
+        "sites",
+        "json",
+        "categories",
+        "threads",
+        "top"
+    };
+    return std::find(modes.begin(), modes.end(), mode) != modes.end();
+}
+
+// Logs the time of the whole run when main returns
+class TRunTimer {
+public:
+    explicit TRunTimer(const std::string& mode)
+        : Mode(mode)
+    {}
+
+    ~TRunTimer() {
+        LOG_DEBUG("Mode " << Mode << ": " << Timer.Elapsed() << " ms");
+    }
+
+private:
+    const std::string Mode;
+    TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> Timer;
+};
+
+// Files of the document and of the copies folded into it
+std::vector<std::string> GetFileNames(const TDocument& doc) {
+    std::vector<std::string> fileNames = {CleanFileName(doc.FileName)};
+    for (const std::string& fileName : doc.DuplicateFileNames) {
+        fileNames.push_back(CleanFileName(fileName));
+    }
+    return fileNames;
+}
+
 uint64_t GetIterTimestamp(const std::vector<TDocument>& documents, double percentile) {
     // In production ts.now() should be here.
     // In this case we have percentile of documents timestamps because of the small percent of wrong dates.
@@ -25,323 +82,618 @@ uint64_t GetIterTimestamp(const std::vector<TDocument>& documents, double percen
     return documents[index].FetchTime;
 }
 
-int main(int argc, char** argv) {
-    try {
-        po::options_description desc("options");
-        desc.add_options()
-            ("mode", po::value<std::string>()->required(), "mode")
-            ("input", po::value<std::string>()->required(), "input")
-            ("lang_detect_model", po::value<std::string>()->default_value("models/lang_detect.ftz"), "lang_detect_model")
-            ("en_cat_detect_model", po::value<std::string>()->default_value("models/en_cat_v2.ftz"), "en_cat_detect_model")
-            ("ru_cat_detect_model", po::value<std::string>()->default_value("models/ru_cat_v2.ftz"), "ru_cat_detect_model")
-            ("en_vector_model", po::value<std::string>()->default_value("models/en_vectors_v2.bin"), "en_vector_model")
-            ("ru_vector_model", po::value<std::string>()->default_value("models/ru_vectors_v2.bin"), "ru_vector_model")
-            ("clustering_type", po::value<std::string>()->default_value("slink"), "clustering_type")
-            ("en_clustering_distance_threshold", po::value<float>()->default_value(0.02f), "en_clustering_distance_threshold")
-            ("en_clustering_max_words", po::value<size_t>()->default_value(250), "en_clustering_max_words")
-            ("ru_clustering_distance_threshold", po::value<float>()->default_value(0.013f), "ru_clustering_distance_threshold")
-            ("ru_clustering_max_words", po::value<size_t>()->default_value(150), "ru_clustering_max_words")
-            ("en_sentence_embedder_matrix", po::value<std::string>()->default_value("models/en_sentence_embedder/matrix.txt"), "ru_sentence_embedder_matrix")
-            ("en_sentence_embedder_bias", po::value<std::string>()->default_value("models/en_sentence_embedder/bias.txt"), "ru_sentence_embedder_bias")
-            ("ru_sentence_embedder_matrix", po::value<std::string>()->default_value("models/ru_sentence_embedder/matrix.txt"), "ru_sentence_embedder_matrix")
-            ("ru_sentence_embedder_bias", po::value<std::string>()->default_value("models/ru_sentence_embedder/bias.txt"), "ru_sentence_embedder_bias")
-            ("rating", po::value<std::string>()->default_value("models/pagerank_rating.txt"), "rating")
-            ("ndocs", po::value<int>()->default_value(-1), "ndocs")
-            ("min_text_length", po::value<size_t>()->default_value(20), "min_text_length")
-            ("parse_links", po::bool_switch()->default_value(false), "parse_links")
-            ("from_json", po::bool_switch()->default_value(false), "from_json")
-            ("languages", po::value<std::vector<std::string>>()->multitoken()->default_value(std::vector<std::string>{"ru", "en"}, "ru en"), "languages")
-            ("iter_timestamp_percentile", po::value<double>()->default_value(0.99), "iter_timestamp_percentile")
-            ;
-
-        po::positional_options_description p;
-        p.add("mode", 1);
-        p.add("input", 1);
-
-        po::command_line_parser parser{argc, argv};
-        parser.options(desc).positional(p);
-        po::parsed_options parsed_options = parser.run();
-        po::variables_map vm;
-        po::store(parsed_options, vm);
-        po::notify(vm);
+po::options_description GetOptions() {
+    po::options_description desc("options");
+    desc.add_options()
+        ("mode", po::value<std::string>()->required(), "mode")
+        ("input", po::value<std::string>()->required(), "input")
+        ("lang_detect_model", po::value<std::string>()->default_value("models/lang_detect.ftz"), "lang_detect_model")
+        ("en_cat_detect_model", po::value<std::string>()->default_value("models/en_cat_v2.ftz"), "en_cat_detect_model")
+        ("ru_cat_detect_model", po::value<std::string>()->default_value("models/ru_cat_v2.ftz"), "ru_cat_detect_model")
+        ("en_vector_model", po::value<std::string>()->default_value("models/en_vectors_v2.bin"), "en_vector_model")
+        ("ru_vector_model", po::value<std::string>()->default_value("models/ru_vectors_v2.bin"), "ru_vector_model")
+        ("en_vector_matrix", po::value<std::string>()->default_value(""), "en_vector_matrix")
+        ("ru_vector_matrix", po::value<std::string>()->default_value(""), "ru_vector_matrix")
+        ("clustering_type", po::value<std::string>()->default_value("slink"), "clustering_type")
+        ("en_clustering_distance_threshold", po::value<float>()->default_value(0.02f), "en_clustering_distance_threshold")
+        ("en_clustering_max_words", po::value<size_t>()->default_value(250), "en_clustering_max_words")
+        ("ru_clustering_distance_threshold", po::value<float>()->default_value(0.013f), "ru_clustering_distance_threshold")
+        ("ru_clustering_max_words", po::value<size_t>()->default_value(150), "ru_clustering_max_words")
+        ("en_sentence_embedder_matrix", po::value<std::string>()->default_value("models/en_sentence_embedder/matrix.txt"), "ru_sentence_embedder_matrix")
+        ("en_sentence_embedder_bias", po::value<std::string>()->default_value("models/en_sentence_embedder/bias.txt"), "ru_sentence_embedder_bias")
+        ("ru_sentence_embedder_matrix", po::value<std::string>()->default_value("models/ru_sentence_embedder/matrix.txt"), "ru_sentence_embedder_matrix")
+        ("ru_sentence_embedder_bias", po::value<std::string>()->default_value("models/ru_sentence_embedder/bias.txt"), "ru_sentence_embedder_bias")
+        ("rating", po::value<std::string>()->default_value("models/pagerank_rating.txt"), "rating")
+        ("ndocs", po::value<int>()->default_value(-1), "ndocs")
+        ("sort_by_inode", po::bool_switch()->default_value(false), "sort_by_inode")
+        ("min_text_length", po::value<size_t>()->default_value(20), "min_text_length")
+        ("parse_links", po::bool_switch()->default_value(false), "parse_links")
+        ("from_json", po::bool_switch()->default_value(false), "from_json")
+        ("html_parser", po::value<std::string>()->default_value("streaming"), "html_parser")
+        ("reader", po::value<std::string>()->default_value("io_uring"), "reader")
+        ("read_budget_mb", po::value<size_t>()->default_value(256), "read_budget_mb")
+        ("output_format", po::value<std::string>()->default_value("json"), "output_format")
+        ("disable_script_detection", po::bool_switch()->default_value(false), "disable_script_detection")
+        ("max_document_kb", po::value<size_t>()->default_value(0), "max_document_kb")
+        ("max_paragraphs", po::value<size_t>()->default_value(0), "max_paragraphs")
+        ("max_text_length", po::value<size_t>()->default_value(0), "max_text_length")
+        ("max_out_links", po::value<size_t>()->default_value(0), "max_out_links")
+        ("slowest_documents", po::value<size_t>()->default_value(0), "slowest_documents")
+        ("stats", po::bool_switch()->default_value(false), "stats")
+        ("category_max_tokens", po::value<size_t>()->default_value(0), "category_max_tokens")
+        ("vector_max_tokens", po::value<int>()->default_value(-1), "vector_max_tokens")
+        ("languages", po::value<std::vector<std::string>>()->multitoken()->default_value(std::vector<std::string>{"ru", "en"}, "ru en"), "languages")
+        ("iter_timestamp_percentile", po::value<double>()->default_value(0.99), "iter_timestamp_percentile")
+        ("max_jobs", po::value<size_t>()->default_value(4), "max_jobs")
+        ;
+    return desc;
+}
 
-        // Args check
-        if (!vm.count("mode") || !vm.count("input")) {
-            std::cerr << "Not enough arguments" << std::endl;
-            return -1;
+// Models, ratings and sentence embedders are independent, they are loaded in the background
+// while the input is listed and the first documents are parsed. Only the models some stage
+// of the level needs for the languages are loaded, the clustering needs all of them.
+class TResources {
+public:
+    TResources(const po::variables_map& vm, EAnnotationLevel level, const std::set<std::string>& languages) {
+        LOG_DEBUG("Loading models...");
+        const std::set<std::string> clusteringLanguages = {"ru", "en"};
+        std::vector<std::string> modelsOptions = {"lang_detect_model"};
+        // Vector models converted by tgnews_convert map their input matrices
+        std::map<std::string, std::string> inputMatrixPaths;
+        for (const std::string& language : languages) {
+            modelsOptions.push_back(language + "_cat_detect_model");
+            if (level == AL_FULL && clusteringLanguages.find(language) != clusteringLanguages.end()) {
+                const std::string optionName = language + "_vector_model";
+                modelsOptions.push_back(optionName);
+                if (vm.count(language + "_vector_matrix")) {
+                    inputMatrixPaths[optionName] = vm[language + "_vector_matrix"].as<std::string>();
+                }
+                Embedders[language] = nullptr;
+            }
         }
-        std::string mode = vm["mode"].as<std::string>();
-        LOG_DEBUG("Mode: " << mode);
-        std::vector<std::string> modes = {
-            "languages",
-            "news",
-            "sites",
-            "json",
-            "categories",
-            "threads",
-            "top"
-        };
-        if (std::find(modes.begin(), modes.end(), mode) == modes.end()) {
-            std::cerr << "Unknown or unsupported mode!" << std::endl;
-            return -1;
+        for (const auto& optionName : modelsOptions) {
+            if (!vm.count(optionName)) {
+                throw std::runtime_error("No " + optionName + " option for the requested languages!");
+            }
+            const auto inputMatrixPath = inputMatrixPaths.find(optionName);
+            Models.Load(
+                optionName,
+                vm[optionName].as<std::string>(),
+                LoadingPool,
+                inputMatrixPath != inputMatrixPaths.end() ? inputMatrixPath->second : std::string());
+            ModelNames.push_back(optionName);
         }
+        if (level < AL_FULL) {
+            return;
+        }
+        const std::string ratingPath = vm["rating"].as<std::string>();
+        ClusteringTasks.push_back(LoadingPool.enqueue([this, ratingPath]() {
+            TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> timer;
+            AgencyRating.Load(ratingPath);
+            LOG_DEBUG("Agency ratings loaded: " << timer.Elapsed() << " ms, ready at " << StartupTimer.Elapsed() << " ms");
+        }).share());
+        // The tasks start in the order they are queued, the vector models are being loaded by then.
+        // Every task fills its own element of the map, the map itself does not change.
+        for (auto& pair : Embedders) {
+            const std::string& language = pair.first;
+            std::unique_ptr<TFastTextEmbedder>* embedder = &pair.second;
+            const size_t maxWords = vm[language + "_clustering_max_words"].as<size_t>();
+            const std::string matrixPath = vm[language + "_sentence_embedder_matrix"].as<std::string>();
+            const std::string biasPath = vm[language + "_sentence_embedder_bias"].as<std::string>();
+            ClusteringTasks.push_back(LoadingPool.enqueue([this, language, embedder, maxWords, matrixPath, biasPath]() {
+                TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> timer;
+                embedder->reset(new TFastTextEmbedder(
+                    Models.Get(language + "_vector_model"),
+                    TFastTextEmbedder::AM_Matrix,
+                    maxWords,
+                    matrixPath,
+                    biasPath,
+                    Models.GetInputMatrix(language + "_vector_model")
+                ));
+                LOG_DEBUG("Sentence embedder " << language << " loaded: " << timer.Elapsed()
+                    << " ms with the vector model, ready at " << StartupTimer.Elapsed() << " ms");
+            }).share());
+        }
+    }
 
-        // Load models
-        LOG_DEBUG("Loading models...");
-        std::vector<std::string> modelsOptions = {
-            "lang_detect_model",
-            "en_cat_detect_model",
-            "ru_cat_detect_model",
-            "en_vector_model",
-            "ru_vector_model"
-        };
-        TModelStorage models;
-        for (const auto& optionName : modelsOptions) {
-            const std::string modelPath = vm[optionName].as<std::string>();
-            std::unique_ptr<fasttext::FastText> model(new fasttext::FastText());
-            models.emplace(optionName, std::move(model));
-            models.at(optionName)->loadModel(modelPath);
-            LOG_DEBUG("FastText " << optionName << " loaded");
+    const TModelStorage& GetModels() const { return Models; }
+
+    // Waits for everything and rethrows the errors of the loading
+    void Wait() const {
+        for (const std::string& name : ModelNames) {
+            Models.Get(name);
+        }
+        WaitClustering();
+    }
+
+    // Wait for the ratings and the embedders and rethrow the errors of their loading
+    const TAgencyRating& GetAgencyRating() const {
+        WaitClustering();
+        return AgencyRating;
+    }
+
+    const std::map<std::string, std::unique_ptr<TFastTextEmbedder>>& GetEmbedders() const {
+        WaitClustering();
+        return Embedders;
+    }
+
+    double GetStartupTimeMs() const { return StartupTimer.Elapsed(); }
+
+private:
+    void WaitClustering() const {
+        for (const std::shared_future<void>& task : ClusteringTasks) {
+            task.get();
         }
+    }
 
-        // Load agency ratings
-        LOG_DEBUG("Loading agency ratings...");
-        const std::string ratingPath = vm["rating"].as<std::string>();
-        TAgencyRating agencyRating(ratingPath);
-        LOG_DEBUG("Agency ratings loaded");
-
-        // Read file names
-        LOG_DEBUG("Reading file names...");
-        int nDocs = vm["ndocs"].as<int>();
-        bool fromJson = vm["from_json"].as<bool>();
-        std::vector<std::string> fileNames;
-        if (!fromJson) {
-            std::string sourceDir = vm["input"].as<std::string>();
-            ReadFileNames(sourceDir, fileNames, nDocs);
-            LOG_DEBUG("Files count: " << fileNames.size());
-        } else {
-            std::string fileName = vm["input"].as<std::string>();
-            fileNames.push_back(fileName);
-            LOG_DEBUG("JSON file as input");
+private:
+    TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> StartupTimer;
+    TModelStorage Models;
+    std::vector<std::string> ModelNames;
+    TAgencyRating AgencyRating;
+    std::map<std::string, std::unique_ptr<TFastTextEmbedder>> Embedders;
+    std::vector<std::shared_future<void>> ClusteringTasks;
+    // Destroyed first, so the loading tasks are finished before what they fill
+    TThreadPool LoadingPool;
+};
+
+// Runs a mode on the input and writes what the command line prints.
+// Concurrent jobs can share the resources and the thread pool.
+void RunJob(const po::variables_map& vm, const TResources& resources, std::ostream& out, TThreadPool* threadPool) {
+    std::string mode = vm["mode"].as<std::string>();
+    LOG_DEBUG("Mode: " << mode);
+    if (!IsKnownMode(mode)) {
+        throw std::runtime_error("Unknown or unsupported mode!");
+    }
+    TRunTimer runTimer(mode);
+
+    // Parse files and annotate with classifiers
+    int nDocs = vm["ndocs"].as<int>();
+    bool fromJson = vm["from_json"].as<bool>();
+    bool sortByInode = vm["sort_by_inode"].as<bool>();
+    std::vector<std::string> l = vm["languages"].as<std::vector<std::string>>();
+    std::set<std::string> languages(l.begin(), l.end());
+    TAnnotateOptions options;
+    options.MinTextLength = vm["min_text_length"].as<size_t>();
+    options.ParseLinks = vm["parse_links"].as<bool>();
+    options.FromJson = fromJson;
+    options.DetectScripts = !vm["disable_script_detection"].as<bool>();
+    // Pathological pages are truncated, zero turns a limit off
+    options.Limits.MaxBytes = vm["max_document_kb"].as<size_t>() << 10;
+    options.Limits.MaxParagraphs = vm["max_paragraphs"].as<size_t>();
+    options.Limits.MaxTextLength = vm["max_text_length"].as<size_t>();
+    options.Limits.MaxOutLinks = vm["max_out_links"].as<size_t>();
+    options.SlowestCount = vm["slowest_documents"].as<size_t>();
+    if (vm["stats"].as<bool>()) {
+        options.Stats = &std::cerr;
+    }
+    // Texts are tokenized only as far as the classifier and the embedder read them.
+    // By default the embedder limit follows the clustering, it reads one word more than max_words.
+    const int vectorMaxTokens = vm["vector_max_tokens"].as<int>();
+    for (const std::string& language : languages) {
+        TTokenLimits& limits = options.TokenLimits[language];
+        limits.MaxCategoryTokens = vm["category_max_tokens"].as<size_t>();
+        if (vectorMaxTokens >= 0) {
+            limits.MaxVectorTokens = vectorMaxTokens;
+        } else if (vm.count(language + "_clustering_max_words")) {
+            limits.MaxVectorTokens = vm[language + "_clustering_max_words"].as<size_t>() + 1;
         }
+    }
+    const std::string htmlParserName = vm["html_parser"].as<std::string>();
+    if (htmlParserName != "streaming" && htmlParserName != "tinyxml") {
+        throw std::runtime_error("Unknown html parser!");
+    }
+    options.HtmlParser = htmlParserName == "tinyxml" ? HP_TINYXML : HP_STREAMING;
+    const std::string readerName = vm["reader"].as<std::string>();
+    if (readerName != "io_uring" && readerName != "pread" && readerName != "mmap") {
+        throw std::runtime_error("Unknown reader!");
+    }
+    options.ReadMethod = readerName == "io_uring" ? RM_IO_URING : (readerName == "pread" ? RM_PREAD : RM_MMAP);
+    options.ReadBudget = vm["read_budget_mb"].as<size_t>() << 20;
+    const std::string outputFormat = vm["output_format"].as<std::string>();
+    if (outputFormat != "json" && outputFormat != "jsonl") {
+        throw std::runtime_error("Unknown output format!");
+    }
+    // JSON Lines are printed as soon as documents are annotated
+    // Copies found after their document was printed get lines of their own
+    if (mode == "json" && outputFormat == "jsonl") {
+        options.OnDocument = [&out](const TDocument& doc) {
+            out << doc.ToJson().dump() << '\n' << std::flush;
+        };
+        options.OnDuplicate = options.OnDocument;
+    }
+    options.Level = GetAnnotationLevel(mode);
+    // Copies on other sites have titles of their own, the sites list every one of them
+    options.Deduplicate = mode != "sites";
+    options.ThreadPool = threadPool;
 
-        // Parse files and annotate with classifiers
-        std::vector<std::string> l = vm["languages"].as<std::vector<std::string>>();
-        std::set<std::string> languages(l.begin(), l.end());
-        size_t minTextLength = vm["min_text_length"].as<size_t>();
-        bool parseLinks = vm["parse_links"].as<bool>();
-        std::vector<TDocument> docs;
-        Annotate(
-            fileNames,
-            models,
-            languages,
-            docs,
-            /* minTextLength = */ minTextLength,
-            /* parseLinks */ parseLinks,
-            /* fromJson */ fromJson);
-
-        // Output
-        if (mode == "languages") {
-            nlohmann::json outputJson = nlohmann::json::array();
-            std::map<std::string, std::vector<std::string>> langToFiles;
-            for (const TDocument& doc : docs) {
-                langToFiles[doc.Language.get()].push_back(CleanFileName(doc.FileName));
+    const TModelStorage& models = resources.GetModels();
+    const std::set<std::string> clusteringLanguages = {"ru", "en"};
+
+    std::vector<TDocument> docs;
+    if (!fromJson && IsTarArchive(vm["input"].as<std::string>())) {
+        LOG_DEBUG("Archive as input");
+        AnnotateArchive(vm["input"].as<std::string>(), models, languages, docs, nDocs, options);
+    } else if (!fromJson) {
+        std::string sourceDir = vm["input"].as<std::string>();
+        AnnotateDirectory(sourceDir, models, languages, docs, nDocs, sortByInode, options);
+    } else {
+        std::vector<std::string> fileNames = {vm["input"].as<std::string>()};
+        LOG_DEBUG("JSON file as input");
+        Annotate(fileNames, models, languages, docs, options);
+    }
+
+    LOG_DEBUG("Startup: annotation finished at " << resources.GetStartupTimeMs() << " ms, "
+        << models.GetWaitTimeMs() << " ms of thread time waiting for models");
+
+    // Output
+    if (mode == "languages") {
+        nlohmann::json outputJson = nlohmann::json::array();
+        std::map<std::string, std::vector<std::string>> langToFiles;
+        for (const TDocument& doc : docs) {
+            for (const std::string& fileName : GetFileNames(doc)) {
+                langToFiles[doc.Language.get()].push_back(fileName);
             }
-            for (const auto& pair : langToFiles) {
-                const std::string& language = pair.first;
-                const std::vector<std::string>& files = pair.second;
-                nlohmann::json object = {
-                    {"lang_code", language},
-                    {"articles", files}
-                };
-                outputJson.push_back(object);
+        }
+        for (const auto& pair : langToFiles) {
+            const std::string& language = pair.first;
+            const std::vector<std::string>& files = pair.second;
+            nlohmann::json object = {
+                {"lang_code", language},
+                {"articles", files}
+            };
+            outputJson.push_back(object);
+        }
+        out << outputJson.dump(4) << std::endl;
+        return;
+    } else if (mode == "sites") {
+        nlohmann::json outputJson = nlohmann::json::array();
+        std::unordered_map<std::string, std::vector<std::string>> siteToTitles;
+        for (const TDocument& doc : docs) {
+            siteToTitles[doc.SiteName].push_back(doc.Title);
+        }
+        for (const auto& pair : siteToTitles) {
+            const std::string& site = pair.first;
+            const std::vector<std::string>& titles = pair.second;
+            nlohmann::json object = {
+                {"site", site},
+                {"titles", titles}
+            };
+            outputJson.push_back(object);
+        }
+        out << outputJson.dump(4) << std::endl;
+        return;
+    } else if (mode == "json" && outputFormat == "jsonl") {
+        return;
+    } else if (mode == "json") {
+        nlohmann::json outputJson = nlohmann::json::array();
+        for (const TDocument& doc : docs) {
+            outputJson.push_back(doc.ToJson());
+        }
+        out << outputJson.dump(4) << std::endl;
+        return;
+    } else if (mode == "news") {
+        nlohmann::json articles = nlohmann::json::array();
+        for (const TDocument& doc : docs) {
+            for (const std::string& fileName : GetFileNames(doc)) {
+                articles.push_back(fileName);
             }
-            std::cout << outputJson.dump(4) << std::endl;
-            return 0;
-        } else if (mode == "sites") {
-            nlohmann::json outputJson = nlohmann::json::array();
-            std::unordered_map<std::string, std::vector<std::string>> siteToTitles;
-            for (const TDocument& doc : docs) {
-                siteToTitles[doc.SiteName].push_back(doc.Title);
+        }
+        nlohmann::json outputJson = nlohmann::json::object();
+        outputJson["articles"] = articles;
+        out << outputJson.dump(4) << std::endl;
+        return;
+    } else if (mode == "categories") {
+        nlohmann::json outputJson = nlohmann::json::array();
+        std::vector<std::vector<std::string>> catToFiles(NC_COUNT);
+        for (const TDocument& doc : docs) {
+            ENewsCategory category = doc.Category;
+            if (category == NC_UNDEFINED || category == NC_NOT_NEWS) {
+                continue;
             }
-            for (const auto& pair : siteToTitles) {
-                const std::string& site = pair.first;
-                const std::vector<std::string>& titles = pair.second;
-                nlohmann::json object = {
-                    {"site", site},
-                    {"titles", titles}
-                };
-                outputJson.push_back(object);
+            for (const std::string& fileName : GetFileNames(doc)) {
+                catToFiles[static_cast<size_t>(category)].push_back(fileName);
             }
-            std::cout << outputJson.dump(4) << std::endl;
-            return 0;
-        } else if (mode == "json") {
-            nlohmann::json outputJson = nlohmann::json::array();
-            for (const TDocument& doc : docs) {
-                outputJson.push_back(doc.ToJson());
+            LOG_DEBUG(category << "\t" << doc.Title);
+        }
+        for (size_t i = 0; i < NC_COUNT; i++) {
+            ENewsCategory category = static_cast<ENewsCategory>(i);
+            const std::vector<std::string>& files = catToFiles[i];
+            nlohmann::json object = {
+                {"category", category},
+                {"articles", files}
+            };
+            outputJson.push_back(object);
+        }
+        out << outputJson.dump(4) << std::endl;
+        return;
+    } else if (mode != "threads" && mode != "top") {
+        assert(false);
+    }
+
+    // Clustering
+    std::set<std::string> clusteredLanguages;
+    for (const auto& language : languages) {
+        if (clusteringLanguages.find(language) == clusteringLanguages.end()) {
+            LOG_DEBUG("Language '" << language << "' is not supported for clustering!");
+        } else {
+            clusteredLanguages.insert(language);
+        }
+    }
+    TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> waitTimer;
+    const TAgencyRating& agencyRating = resources.GetAgencyRating();
+    const std::map<std::string, std::unique_ptr<TFastTextEmbedder>>& embedders = resources.GetEmbedders();
+    for (const std::string& language : clusteredLanguages) {
+        if (embedders.find(language) == embedders.end()) {
+            throw std::runtime_error("Sentence embedder " + language + " is not loaded for the requested languages");
+        }
+    }
+    LOG_DEBUG("Startup: " << waitTimer.Elapsed() << " ms waiting for ratings and sentence embedders");
+
+    // Every url is parsed once, Rank and Summarize work with host ids
+    THostTable hostTable(agencyRating);
+    for (TDocument& doc : docs) {
+        doc.HostId = hostTable.Add(doc.Url);
+        doc.AgencyScore = hostTable.GetScore(doc.HostId);
+    }
+    LOG_DEBUG("Hosts: " << hostTable.Size());
+    std::stable_sort(docs.begin(), docs.end(),
+        [](const TDocument& d1, const TDocument& d2) {
+            if (d1.FetchTime == d2.FetchTime) {
+                if (d1.FileName.empty() && d2.FileName.empty()) {
+                    return d1.Title.length() < d2.Title.length();
+                }
+                return d1.FileName < d2.FileName;
             }
-            std::cout << outputJson.dump(4) << std::endl;
-            return 0;
-        } else if (mode == "news") {
-            nlohmann::json articles = nlohmann::json::array();
-            for (const TDocument& doc : docs) {
-                articles.push_back(CleanFileName(doc.FileName));
+            return d1.FetchTime < d2.FetchTime;
+        }
+    );
+    const double iterTimestampPercentile = vm["iter_timestamp_percentile"].as<double>();
+    uint64_t iterTimestamp = GetIterTimestamp(docs, iterTimestampPercentile);
+
+    const std::string clusteringType = vm["clustering_type"].as<std::string>();
+    assert(clusteringType == "slink");
+
+    std::map<std::string, std::unique_ptr<TClustering>> clusterings;
+    for (const std::string& language : clusteredLanguages) {
+        const float distanceThreshold = vm[language+"_clustering_distance_threshold"].as<float>();
+        std::unique_ptr<TClustering> clustering(
+            new TSlinkClustering(*embedders.at(language), distanceThreshold)
+        );
+        clusterings[language] = std::move(clustering);
+    }
+
+    std::map<std::string, std::vector<TDocument>> lang2Docs;
+    while (!docs.empty()) {
+        const TDocument& doc = docs.back();
+        assert(doc.Language);
+        const std::string& language = doc.Language.get();
+        if (clusteredLanguages.find(language) != clusteredLanguages.end()) {
+            lang2Docs[language].push_back(doc);
+        }
+        docs.pop_back();
+    }
+    docs.shrink_to_fit();
+    docs.clear();
+
+    TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> clusteringTimer;
+    TClusters clusters;
+    for (const std::string& language : clusteredLanguages) {
+        const TClusters langClusters = clusterings[language]->Cluster(lang2Docs[language]);
+        std::copy_if(
+            langClusters.cbegin(),
+            langClusters.cend(),
+            std::back_inserter(clusters),
+            [](const TNewsCluster& cluster) {
+                return cluster.GetSize() > 0;
             }
-            nlohmann::json outputJson = nlohmann::json::object();
-            outputJson["articles"] = articles;
-            std::cout << outputJson.dump(4) << std::endl;
-            return 0;
-        } else if (mode == "categories") {
-            nlohmann::json outputJson = nlohmann::json::array();
-            std::vector<std::vector<std::string>> catToFiles(NC_COUNT);
-            for (const TDocument& doc : docs) {
-                ENewsCategory category = doc.Category;
-                if (category == NC_UNDEFINED || category == NC_NOT_NEWS) {
-                    continue;
+        );
+    }
+    LOG_DEBUG("Clustering: " << clusteringTimer.Elapsed() << " ms (" << clusters.size() << " clusters)");
+
+    //Summarization
+    Summarize(clusters, embedders);
+    if (mode == "threads") {
+        nlohmann::json outputJson = nlohmann::json::array();
+        for (const auto& cluster : clusters) {
+            nlohmann::json files = nlohmann::json::array();
+            for (const TDocument& doc : cluster.GetDocuments()) {
+                for (const std::string& fileName : GetFileNames(doc)) {
+                    files.push_back(fileName);
                 }
-                catToFiles[static_cast<size_t>(category)].push_back(CleanFileName(doc.FileName));
-                LOG_DEBUG(category << "\t" << doc.Title);
             }
-            for (size_t i = 0; i < NC_COUNT; i++) {
-                ENewsCategory category = static_cast<ENewsCategory>(i);
-                const std::vector<std::string>& files = catToFiles[i];
-                nlohmann::json object = {
-                    {"category", category},
-                    {"articles", files}
-                };
-                outputJson.push_back(object);
-            }
-            std::cout << outputJson.dump(4) << std::endl;
-            return 0;
-        } else if (mode != "threads" && mode != "top") {
-            assert(false);
-        }
+            nlohmann::json object = {
+                {"title", cluster.GetTitle()},
+                {"articles", files}
+            };
+            outputJson.push_back(object);
 
-        // Clustering
-        const std::set<std::string> clusteringLanguages = {"ru", "en"};
-        for (const auto& language : languages) {
-            if (clusteringLanguages.find(language) == clusteringLanguages.end()) {
-                LOG_DEBUG("Language '" << language << "' is not supported for clustering!");
+            if (cluster.GetSize() >= 2) {
+                LOG_DEBUG("\n         CLUSTER: " << cluster.GetTitle());
+                for (const TDocument& doc : cluster.GetDocuments()) {
+                    LOG_DEBUG("  " << doc.Title << " (" << doc.Url << ")");
+                }
             }
         }
-        std::stable_sort(docs.begin(), docs.end(),
-            [](const TDocument& d1, const TDocument& d2) {
-                if (d1.FetchTime == d2.FetchTime) {
-                    if (d1.FileName.empty() && d2.FileName.empty()) {
-                        return d1.Title.length() < d2.Title.length();
-                    }
-                    return d1.FileName < d2.FileName;
+        out << outputJson.dump(4) << std::endl;
+        return;
+    } else if (mode != "top") {
+        assert(false);
+    }
+
+    // Ranking
+    const auto tops = Rank(clusters, iterTimestamp);
+    nlohmann::json outputJson = nlohmann::json::array();
+    for (auto it = tops.begin(); it != tops.end(); ++it) {
+        const auto category = static_cast<ENewsCategory>(std::distance(tops.begin(), it));
+        nlohmann::json rubricTop = {
+            {"category", category},
+            {"threads", nlohmann::json::array()}
+        };
+        for (const auto& cluster : *it) {
+            nlohmann::json object = {
+                {"title", cluster.Title},
+                {"category", cluster.Category},
+                {"articles", nlohmann::json::array()}
+            };
+            for (const TDocument& doc : cluster.Cluster.get().GetDocuments()) {
+                for (const std::string& fileName : GetFileNames(doc)) {
+                    object["articles"].push_back(fileName);
                 }
-                return d1.FetchTime < d2.FetchTime;
             }
-        );
-        const double iterTimestampPercentile = vm["iter_timestamp_percentile"].as<double>();
-        uint64_t iterTimestamp = GetIterTimestamp(docs, iterTimestampPercentile);
+            rubricTop["threads"].push_back(object);
+        }
+        outputJson.push_back(rubricTop);
+    }
+    out << outputJson.dump(4) << std::endl;
+    return;
+}
 
-        const std::string clusteringType = vm["clustering_type"].as<std::string>();
-        assert(clusteringType == "slink");
+// Parses the command line and the arguments of the daemon jobs the same way
+po::variables_map ParseArguments(const std::vector<std::string>& args) {
+    const po::options_description desc = GetOptions();
+    po::positional_options_description p;
+    p.add("mode", 1);
+    p.add("input", 1);
 
-        std::map<std::string, std::unique_ptr<TClustering>> clusterings;
-        std::map<std::string, std::unique_ptr<TFastTextEmbedder>> embedders;
-        for (const std::string& language : clusteringLanguages) {
-            const std::string matrixPath = vm[language + "_sentence_embedder_matrix"].as<std::string>();
-            const std::string biasPath = vm[language + "_sentence_embedder_bias"].as<std::string>();
-            const size_t maxWords = vm[language + "_clustering_max_words"].as<size_t>();
+    po::command_line_parser parser{args};
+    parser.options(desc).positional(p);
+    po::parsed_options parsed_options = parser.run();
+    po::variables_map vm;
+    po::store(parsed_options, vm);
+    po::notify(vm);
+    return vm;
+}
 
-            std::unique_ptr<TFastTextEmbedder> embedder(new TFastTextEmbedder(
-                *models.at(language + "_vector_model"),
-                TFastTextEmbedder::AM_Matrix,
-                maxWords,
-                matrixPath,
-                biasPath
-            ));
-            embedders[language] = std::move(embedder);
-            const float distanceThreshold = vm[language+"_clustering_distance_threshold"].as<float>();
-            std::unique_ptr<TClustering> clustering(
-                new TSlinkClustering(*embedders[language], distanceThreshold)
-            );
-            clusterings[language] = std::move(clustering);
-        }
+// Options of what the daemon loads at the start, jobs get the values of the daemon
+const std::vector<std::string> DAEMON_OPTIONS = {
+    "lang_detect_model",
+    "en_cat_detect_model",
+    "ru_cat_detect_model",
+    "en_vector_model",
+    "ru_vector_model",
+    "en_vector_matrix",
+    "ru_vector_matrix",
+    "en_clustering_max_words",
+    "ru_clustering_max_words",
+    "en_sentence_embedder_matrix",
+    "en_sentence_embedder_bias",
+    "ru_sentence_embedder_matrix",
+    "ru_sentence_embedder_bias",
+    "rating",
+    "max_jobs"
+};
 
-        std::map<std::string, std::vector<TDocument>> lang2Docs;
-        while (!docs.empty()) {
-            const TDocument& doc = docs.back();
-            assert(doc.Language);
-            const std::string& language = doc.Language.get();
-            if (clusteringLanguages.find(language) != clusteringLanguages.end()) {
-                lang2Docs[language].push_back(doc);
+std::string ToArgument(const nlohmann::json& value) {
+    return value.is_string() ? value.get<std::string>() : value.dump();
+}
+
+// A job is {"mode": "top", "input": "data", "options": {"ndocs": 100, "from_json": true}}, or the same
+// with "documents": [...] instead of the input. Its response is the output of the command line or
+// {"error": "..."}. The documents are written to a temporary JSON Lines file and read from it.
+void HandleJob(
+    const std::string& request,
+    const po::variables_map& daemonVm,
+    const TResources& resources,
+    TThreadPool& threadPool,
+    std::ostream& response)
+{
+    boost::filesystem::path documentsPath;
+    try {
+        const nlohmann::json job = nlohmann::json::parse(request);
+        const nlohmann::json options = job.value("options", nlohmann::json::object());
+        std::vector<std::string> args = {job.at("mode").get<std::string>()};
+        if (job.count("documents")) {
+            documentsPath = boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("tgnews-%%%%-%%%%-%%%%.jsonl");
+            std::ofstream documentsStream(documentsPath.string());
+            for (const nlohmann::json& document : job.at("documents")) {
+                documentsStream << document.dump() << '\n';
+            }
+            if (!documentsStream.flush()) {
+                throw std::runtime_error("Can't write documents of the job");
             }
-            docs.pop_back();
+            args.push_back(documentsPath.string());
+            args.push_back("--from_json");
+        } else {
+            args.push_back(job.at("input").get<std::string>());
         }
-        docs.shrink_to_fit();
-        docs.clear();
-
-        TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> clusteringTimer;
-        TClusters clusters;
-        for (const std::string& language : clusteringLanguages) {
-            const TClusters langClusters = clusterings[language]->Cluster(lang2Docs[language]);
-            std::copy_if(
-                langClusters.cbegin(),
-                langClusters.cend(),
-                std::back_inserter(clusters),
-                [](const TNewsCluster& cluster) {
-                    return cluster.GetSize() > 0;
-                }
-            );
+        for (const std::string& optionName : DAEMON_OPTIONS) {
+            if (options.count(optionName)) {
+                throw std::runtime_error("Option " + optionName + " is set when the daemon starts");
+            }
+            const po::variable_value& value = daemonVm[optionName];
+            args.push_back("--" + optionName);
+            const std::string* stringValue = boost::any_cast<std::string>(&value.value());
+            args.push_back(stringValue ? *stringValue : std::to_string(value.as<size_t>()));
         }
-        LOG_DEBUG("Clustering: " << clusteringTimer.Elapsed() << " ms (" << clusters.size() << " clusters)");
-
-        //Summarization
-        Summarize(clusters, agencyRating, embedders);
-        if (mode == "threads") {
-            nlohmann::json outputJson = nlohmann::json::array();
-            for (const auto& cluster : clusters) {
-                nlohmann::json files = nlohmann::json::array();
-                for (const TDocument& doc : cluster.GetDocuments()) {
-                    files.push_back(CleanFileName(doc.FileName));
+        if (!options.count("languages")) {
+            args.push_back("--languages");
+            for (const std::string& language : daemonVm["languages"].as<std::vector<std::string>>()) {
+                args.push_back(language);
+            }
+        }
+        for (auto it = options.begin(); it != options.end(); ++it) {
+            if (it.value().is_boolean()) {
+                if (it.value().get<bool>()) {
+                    args.push_back("--" + it.key());
                 }
-                nlohmann::json object = {
-                    {"title", cluster.GetTitle()},
-                    {"articles", files}
-                };
-                outputJson.push_back(object);
-
-                if (cluster.GetSize() >= 2) {
-                    LOG_DEBUG("\n         CLUSTER: " << cluster.GetTitle());
-                    for (const TDocument& doc : cluster.GetDocuments()) {
-                        LOG_DEBUG("  " << doc.Title << " (" << doc.Url << ")");
-                    }
+                continue;
+            }
+            args.push_back("--" + it.key());
+            if (it.value().is_array()) {
+                for (const nlohmann::json& element : it.value()) {
+                    args.push_back(ToArgument(element));
                 }
+            } else {
+                args.push_back(ToArgument(it.value()));
             }
-            std::cout << outputJson.dump(4) << std::endl;
-            return 0;
-        } else if (mode != "top") {
-            assert(false);
         }
+        std::ostringstream output;
+        RunJob(ParseArguments(args), resources, output, &threadPool);
+        response << output.str();
+    } catch (std::exception& e) {
+        LOG_DEBUG("Job failed: " << e.what());
+        nlohmann::json error = nlohmann::json::object();
+        error["error"] = e.what();
+        response << error.dump() << std::endl;
+    }
+    if (!documentsPath.empty()) {
+        boost::system::error_code error;
+        boost::filesystem::remove(documentsPath, error);
+    }
+}
 
-        // Ranking
-        const auto tops = Rank(clusters, agencyRating, iterTimestamp);
-        nlohmann::json outputJson = nlohmann::json::array();
-        for (auto it = tops.begin(); it != tops.end(); ++it) {
-            const auto category = static_cast<ENewsCategory>(std::distance(tops.begin(), it));
-            nlohmann::json rubricTop = {
-                {"category", category},
-                {"threads", nlohmann::json::array()}
-            };
-            for (const auto& cluster : *it) {
-                nlohmann::json object = {
-                    {"title", cluster.Title},
-                    {"category", cluster.Category},
-                    {"articles", nlohmann::json::array()}
-                };
-                for (const TDocument& doc : cluster.Cluster.get().GetDocuments()) {
-                    object["articles"].push_back(CleanFileName(doc.FileName));
-                }
-                rubricTop["threads"].push_back(object);
-            }
-            outputJson.push_back(rubricTop);
+int main(int argc, char** argv) {
+    try {
+        const po::variables_map vm = ParseArguments(std::vector<std::string>(argv + 1, argv + argc));
+
+        // Args check
+        if (!vm.count("mode") || !vm.count("input")) {
+            std::cerr << "Not enough arguments" << std::endl;
+            return -1;
+        }
+        const std::string mode = vm["mode"].as<std::string>();
+        std::vector<std::string> l = vm["languages"].as<std::vector<std::string>>();
+        std::set<std::string> languages(l.begin(), l.end());
+
+        // The daemon loads what every mode needs once and serves jobs on the socket at the input path
+        if (mode == "daemon") {
+            const TResources resources(vm, AL_FULL, languages);
+            resources.Wait();
+            LOG_DEBUG("Daemon: loaded in " << resources.GetStartupTimeMs() << " ms");
+            TThreadPool threadPool;
+            RunDaemon(vm["input"].as<std::string>(), vm["max_jobs"].as<size_t>(), [&](const std::string& request, std::ostream& response) {
+                HandleJob(request, vm, resources, threadPool, response);
+            });
+            return 0;
+        }
+        if (!IsKnownMode(mode)) {
+            std::cerr << "Unknown or unsupported mode!" << std::endl;
+            return -1;
         }
-        std::cout << outputJson.dump(4) << std::endl;
+        const TResources resources(vm, GetAnnotationLevel(mode), languages);
+        RunJob(vm, resources, std::cout, /* threadPool = */ nullptr);
         return 0;
     } catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,66 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TMappedFile::TMappedFile(const char* fileName, bool populate, size_t maxSize) {
+    Open(fileName, populate, maxSize);
+}
+
+TMappedFile::~TMappedFile() {
+    Close();
+}
+
+bool TMappedFile::Open(const char* fileName, bool populate, size_t maxSize) {
+    Close();
+    Descriptor = ::open(fileName, O_RDONLY | O_CLOEXEC);
+    if (Descriptor == -1) {
+        return false;
+    }
+    struct stat fileStat;
+    if (::fstat(Descriptor, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        Close();
+        return false;
+    }
+    Length = static_cast<size_t>(fileStat.st_size);
+    if (maxSize != 0) {
+        Length = std::min(Length, maxSize);
+    }
+    if (Length == 0) {
+        // mmap refuses empty mappings, an empty file is still a valid empty buffer
+        return true;
+    }
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    // Input files are small and read front to back, fault them in at once
+    if (populate) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void* address = ::mmap(nullptr, Length, PROT_READ, flags, Descriptor, 0);
+    if (address == MAP_FAILED) {
+        Close();
+        return false;
+    }
+    if (!populate) {
+        ::madvise(address, Length, MADV_RANDOM);
+    }
+    Begin = static_cast<const char*>(address);
+    return true;
+}
+
+void TMappedFile::Close() {
+    if (Begin) {
+        ::munmap(const_cast<char*>(Begin), Length);
+    }
+    if (Descriptor != -1) {
+        ::close(Descriptor);
+    }
+    Descriptor = -1;
+    Begin = nullptr;
+    Length = 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file or of its beginning
+class TMappedFile {
+public:
+    TMappedFile() = default;
+    explicit TMappedFile(const char* fileName, bool populate = true, size_t maxSize = 0);
+    TMappedFile(const TMappedFile&) = delete;
+    TMappedFile& operator=(const TMappedFile&) = delete;
+    ~TMappedFile();
+
+    // Without populate the pages are read on first access, in any order.
+    // At most maxSize bytes are mapped, zero maps the whole file.
+    bool Open(const char* fileName, bool populate = true, size_t maxSize = 0);
+    void Close();
+
+    bool IsOpen() const { return Descriptor != -1; }
+    const char* Data() const { return Begin; }
+    size_t Size() const { return Length; }
+
+private:
+    int Descriptor = -1;
+    const char* Begin = nullptr;
+    size_t Length = 0;
+};
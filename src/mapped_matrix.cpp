@@ -0,0 +1,66 @@
+#include "mapped_matrix.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+const char MATRIX_MAGIC[8] = {'T', 'G', 'M', 'A', 'T', 'R', 'I', 'X'};
+const uint32_t MATRIX_VERSION = 1;
+// The rows start on a cache line
+const size_t MATRIX_HEADER_SIZE = 64;
+
+struct TMatrixHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Reserved;
+    uint64_t Rows;
+    uint64_t Cols;
+};
+
+static_assert(sizeof(TMatrixHeader) <= MATRIX_HEADER_SIZE, "Matrix header does not fit");
+
+} // namespace
+
+bool TMappedMatrix::Open(const std::string& fileName) {
+    Begin = nullptr;
+    RowCount = 0;
+    ColCount = 0;
+    // Lookups of word vectors are random, read ahead would only waste the page cache
+    if (!File.Open(fileName.c_str(), /* populate = */ false) || File.Size() < MATRIX_HEADER_SIZE) {
+        return false;
+    }
+    TMatrixHeader header;
+    std::memcpy(&header, File.Data(), sizeof(header));
+    if (std::memcmp(header.Magic, MATRIX_MAGIC, sizeof(MATRIX_MAGIC)) != 0 || header.Version != MATRIX_VERSION) {
+        return false;
+    }
+    if (header.Cols != 0 && header.Rows > (File.Size() - MATRIX_HEADER_SIZE) / sizeof(float) / header.Cols) {
+        return false;
+    }
+    if (MATRIX_HEADER_SIZE + header.Rows * header.Cols * sizeof(float) != File.Size()) {
+        return false;
+    }
+    Begin = reinterpret_cast<const float*>(File.Data() + MATRIX_HEADER_SIZE);
+    RowCount = header.Rows;
+    ColCount = header.Cols;
+    return true;
+}
+
+bool TMappedMatrix::Save(const std::string& fileName, const float* data, size_t rows, size_t cols) {
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out) {
+        return false;
+    }
+    char headerBlock[MATRIX_HEADER_SIZE] = {};
+    TMatrixHeader header = {};
+    std::memcpy(header.Magic, MATRIX_MAGIC, sizeof(MATRIX_MAGIC));
+    header.Version = MATRIX_VERSION;
+    header.Rows = rows;
+    header.Cols = cols;
+    std::memcpy(headerBlock, &header, sizeof(header));
+    out.write(headerBlock, sizeof(headerBlock));
+    out.write(reinterpret_cast<const char*>(data), rows * cols * sizeof(float));
+    return static_cast<bool>(out.flush());
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include <cstddef>
+#include <string>
+
+// Row-major float matrix in a file that is mapped, not read. Rows are paged in on first
+// access, and the pages are shared through the page cache by all processes mapping the file.
+// The file is a 64 byte header with the shape and the rows right after it, in native byte order.
+class TMappedMatrix {
+public:
+    TMappedMatrix() = default;
+    TMappedMatrix(const TMappedMatrix&) = delete;
+    TMappedMatrix& operator=(const TMappedMatrix&) = delete;
+
+    // False for a missing file or a file that is not a whole matrix
+    bool Open(const std::string& fileName);
+    static bool Save(const std::string& fileName, const float* data, size_t rows, size_t cols);
+
+    size_t Rows() const { return RowCount; }
+    size_t Cols() const { return ColCount; }
+    const float* Data() const { return Begin; }
+    const float* Row(size_t index) const { return Begin + index * ColCount; }
+
+private:
+    TMappedFile File;
+    const float* Begin = nullptr;
+    size_t RowCount = 0;
+    size_t ColCount = 0;
+};
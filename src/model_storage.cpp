@@ -0,0 +1,60 @@
+#include "model_storage.h"
+#include "thread_pool.h"
+#include "util.h"
+
+#include <stdexcept>
+
+void TModelStorage::Load(
+    const std::string& name,
+    const std::string& path,
+    TThreadPool& threadPool,
+    const std::string& inputMatrixPath)
+{
+    TModel& model = Models[name];
+    model.Model.reset(new fasttext::FastText());
+    fasttext::FastText* fastText = model.Model.get();
+    TMappedMatrix* inputMatrix = nullptr;
+    if (!inputMatrixPath.empty()) {
+        model.InputMatrix.reset(new TMappedMatrix());
+        inputMatrix = model.InputMatrix.get();
+    }
+    model.Loaded = threadPool.enqueue([this, fastText, inputMatrix, name, path, inputMatrixPath]() {
+        TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> timer;
+        fastText->loadModel(path);
+        if (inputMatrix) {
+            if (!inputMatrix->Open(inputMatrixPath)) {
+                throw std::runtime_error("Bad input matrix of " + name + ": " + inputMatrixPath);
+            }
+            const int64_t rows = fastText->getDictionary()->nwords() + fastText->getArgs().bucket;
+            if (inputMatrix->Rows() != static_cast<size_t>(rows)
+                || inputMatrix->Cols() != static_cast<size_t>(fastText->getDimension()))
+            {
+                throw std::runtime_error("Input matrix " + inputMatrixPath + " does not match " + name);
+            }
+        }
+        LOG_DEBUG("FastText " << name << " loaded: " << timer.Elapsed() << " ms, ready at " << Timer.Elapsed() << " ms");
+    }).share();
+}
+
+const TModelStorage::TModel& TModelStorage::Wait(const std::string& name) const {
+    const auto it = Models.find(name);
+    if (it == Models.end()) {
+        throw std::runtime_error("Model " + name + " is not loaded for the requested mode and languages");
+    }
+    const TModel& model = it->second;
+    if (model.Loaded.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        TTimer<std::chrono::high_resolution_clock, std::chrono::microseconds> timer;
+        model.Loaded.wait();
+        WaitTime += static_cast<uint64_t>(timer.Elapsed());
+    }
+    model.Loaded.get();
+    return model;
+}
+
+fasttext::FastText& TModelStorage::Get(const std::string& name) const {
+    return *Wait(name).Model;
+}
+
+const TMappedMatrix* TModelStorage::GetInputMatrix(const std::string& name) const {
+    return Wait(name).InputMatrix.get();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "mapped_matrix.h"
+#include "timer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <fasttext.h>
+
+class TThreadPool;
+
+// fastText models by their option names, loaded in the background.
+// Get waits for the model and rethrows the error of its loading,
+// a model that was never loaded is an error too.
+class TModelStorage {
+public:
+    // Models are added before any of them is used, Load is not thread safe.
+    // With inputMatrixPath the model is the dictionary written by tgnews_convert
+    // and its input matrix is mapped from that file instead.
+    void Load(
+        const std::string& name,
+        const std::string& path,
+        TThreadPool& threadPool,
+        const std::string& inputMatrixPath = "");
+    fasttext::FastText& Get(const std::string& name) const;
+    // Null for models with their own input matrix
+    const TMappedMatrix* GetInputMatrix(const std::string& name) const;
+
+    // Time the callers of Get spent waiting for the models to load
+    uint64_t GetWaitTimeMs() const { return WaitTime / 1000; }
+
+private:
+    struct TModel {
+        std::unique_ptr<fasttext::FastText> Model;
+        std::unique_ptr<TMappedMatrix> InputMatrix;
+        std::shared_future<void> Loaded;
+    };
+
+    const TModel& Wait(const std::string& name) const;
+
+private:
+    std::unordered_map<std::string, TModel> Models;
+    TTimer<std::chrono::high_resolution_clock, std::chrono::milliseconds> Timer;
+    mutable std::atomic<uint64_t> WaitTime{0};
+};
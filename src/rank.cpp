@@ -1,17 +1,17 @@
 #include "rank.h"
 #include "util.h"
 
+#include <unordered_set>
+
 double ComputeClusterWeight(
     const TNewsCluster& cluster,
-    const TAgencyRating& agencyRating,
     const uint64_t iterTimestamp
 ) {
-    std::set<std::string> seenHosts;
+    std::unordered_set<uint32_t> seenHosts;
     double agenciesWeight = 0.0;
     for (const TDocument& doc : cluster.GetDocuments()) {
-        const std::string& docHost = GetHost(doc.Url);
-        if (seenHosts.insert(docHost).second) {
-            agenciesWeight += agencyRating.ScoreUrl(doc.Url);
+        if (seenHosts.insert(doc.HostId).second) {
+            agenciesWeight += doc.AgencyScore;
         }
     }
 
@@ -29,14 +29,13 @@ double ComputeClusterWeight(
 
 std::vector<std::vector<TWeightedNewsCluster>> Rank(
     const TClusters& clusters,
-    const TAgencyRating& agencyRating,
     uint64_t iterTimestamp
 ) {
     std::vector<TWeightedNewsCluster> weightedClusters;
     for (const TNewsCluster& cluster : clusters) {
         ENewsCategory clusterCategory = cluster.GetCategory();
         const std::string& title = cluster.GetTitle();
-        const double weight = ComputeClusterWeight(cluster, agencyRating, iterTimestamp);
+        const double weight = ComputeClusterWeight(cluster, iterTimestamp);
         weightedClusters.emplace_back(cluster, clusterCategory, title, weight);
     }
 
@@ -1,4 +1,3 @@
-#include "agency_rating.h"
 #include "clustering/clustering.h"
 
 #include <cstdint>
@@ -22,12 +21,10 @@ struct TWeightedNewsCluster {
 
 double ComputeClusterWeight(
     const TNewsCluster& cluster,
-    const TAgencyRating& agencyRating,
     const uint64_t iterTimestamp
 );
 
 std::vector<std::vector<TWeightedNewsCluster>> Rank(
     const TClusters& clusters,
-    const TAgencyRating& agencyRating,
     uint64_t iterTimestamp
 );
@@ -6,7 +6,6 @@
 
 void Summarize(
     TClusters& clusters,
-    const TAgencyRating& agencyRating,
     const std::map<std::string, std::unique_ptr<TFastTextEmbedder>>& embedders
 ) {
     for (auto& cluster : clusters) {
@@ -28,8 +27,7 @@ void Summarize(
             const TDocument& doc = cluster.GetDocuments()[i];
             double docRelevance = docsCosine.row(i).mean();
             double timeMultiplier = Sigmoid(static_cast<double>(doc.FetchTime - freshestTimestamp) / 3600.0 + 12.0);
-            double agencyScore = agencyRating.ScoreUrl(doc.Url);
-            double weight = (agencyScore + docRelevance) * timeMultiplier;
+            double weight = (doc.AgencyScore + docRelevance) * timeMultiplier;
             weights.push_back(weight);
         }
         cluster.SortByWeights(weights);
@@ -1,11 +1,9 @@
 #pragma once
 
-#include "agency_rating.h"
 #include "cluster.h"
 #include "embedder.h"
 
 void Summarize(
     TClusters& clusters,
-    const TAgencyRating& agencyRating,
     const std::map<std::string, std::unique_ptr<TFastTextEmbedder>>& embedders
 );
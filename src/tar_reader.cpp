@@ -0,0 +1,191 @@
+#include "tar_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <zlib.h>
+
+namespace {
+
+const size_t BLOCK_SIZE = 512;
+
+// Offsets of the ustar header fields
+const size_t NAME_OFFSET = 0;
+const size_t NAME_SIZE = 100;
+const size_t SIZE_OFFSET = 124;
+const size_t SIZE_SIZE = 12;
+const size_t CHECKSUM_OFFSET = 148;
+const size_t CHECKSUM_SIZE = 8;
+const size_t TYPE_OFFSET = 156;
+const size_t MAGIC_OFFSET = 257;
+const size_t PREFIX_OFFSET = 345;
+const size_t PREFIX_SIZE = 155;
+
+std::string ReadString(const char* field, size_t size) {
+    return std::string(field, std::find(field, field + size, '\0'));
+}
+
+// Octal, or big-endian base-256 when the high bit of the first byte is set
+uint64_t ReadNumber(const char* field, size_t size) {
+    uint64_t value = 0;
+    if (static_cast<unsigned char>(field[0]) & 0x80) {
+        value = static_cast<unsigned char>(field[0]) & 0x7F;
+        for (size_t i = 1; i < size; i++) {
+            value = (value << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return value;
+    }
+    size_t i = 0;
+    while (i < size && (field[i] == ' ' || field[i] == '\0')) {
+        i++;
+    }
+    for (; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + (field[i] - '0');
+    }
+    return value;
+}
+
+bool IsValidChecksum(const char* block) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        const bool isChecksum = i >= CHECKSUM_OFFSET && i < CHECKSUM_OFFSET + CHECKSUM_SIZE;
+        sum += isChecksum ? ' ' : static_cast<unsigned char>(block[i]);
+    }
+    return sum == ReadNumber(block + CHECKSUM_OFFSET, CHECKSUM_SIZE);
+}
+
+// "<length> <key>=<value>\n" records of a pax extended header
+std::string FindPaxPath(const std::string& records) {
+    size_t position = 0;
+    while (position < records.size()) {
+        const size_t space = records.find(' ', position);
+        if (space == std::string::npos) {
+            break;
+        }
+        const size_t length = std::strtoul(records.c_str() + position, nullptr, 10);
+        if (length == 0 || position + length > records.size()) {
+            break;
+        }
+        const std::string record = records.substr(space + 1, position + length - space - 2);
+        if (boost::algorithm::starts_with(record, "path=")) {
+            return record.substr(5);
+        }
+        position += length;
+    }
+    return std::string();
+}
+
+} // namespace
+
+bool IsTarArchive(const std::string& fileName) {
+    return boost::algorithm::ends_with(fileName, ".tar")
+        || boost::algorithm::ends_with(fileName, ".tar.gz")
+        || boost::algorithm::ends_with(fileName, ".tgz");
+}
+
+TTarReader::TTarReader(const std::string& archiveName, size_t maxBytesInFlight)
+    : ArchiveName(archiveName)
+    , Budget(std::make_shared<TReadBudget>(maxBytesInFlight))
+{
+    // zlib reads uncompressed files transparently
+    gzFile file = gzopen(archiveName.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("Can't open archive: " + archiveName);
+    }
+    gzbuffer(file, 1 << 20);
+    File = file;
+}
+
+TTarReader::~TTarReader() {
+    if (File) {
+        gzclose(static_cast<gzFile>(File));
+    }
+}
+
+TFileDataPtr TTarReader::Next() {
+    std::string longName;
+    char header[BLOCK_SIZE];
+    while (!IsFinished) {
+        if (!ReadBlock(header)) {
+            IsFinished = true;
+            break;
+        }
+        if (std::all_of(header, header + BLOCK_SIZE, [](char ch) { return ch == '\0'; })) {
+            // End of archive marker
+            IsFinished = true;
+            break;
+        }
+        if (!IsValidChecksum(header)) {
+            throw std::runtime_error("Bad tar header in " + ArchiveName);
+        }
+        const size_t size = ReadNumber(header + SIZE_OFFSET, SIZE_SIZE);
+        const size_t paddedSize = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+        const char type = header[TYPE_OFFSET];
+        if (type == 'L' || type == 'x') {
+            std::string records(paddedSize, '\0');
+            ReadExactly(&records[0], paddedSize);
+            records.resize(size);
+            longName = (type == 'L') ? ReadString(records.data(), records.size()) : FindPaxPath(records);
+            continue;
+        }
+        if (type != '0' && type != '\0' && type != '7') {
+            Skip(paddedSize);
+            longName.clear();
+            continue;
+        }
+
+        std::string name = longName;
+        if (name.empty()) {
+            name = ReadString(header + NAME_OFFSET, NAME_SIZE);
+            const bool isUstar = std::memcmp(header + MAGIC_OFFSET, "ustar", 5) == 0;
+            if (isUstar && header[PREFIX_OFFSET] != '\0') {
+                name = ReadString(header + PREFIX_OFFSET, PREFIX_SIZE) + "/" + name;
+            }
+        }
+        Budget->Acquire(size);
+        TFileDataPtr data(new TFileData(name, Budget));
+        data->BudgetBytes = size;
+        data->Buffer.reset(new char[size]);
+        data->Length = size;
+        ReadExactly(data->Buffer.get(), size);
+        Skip(paddedSize - size);
+        data->IsOk = true;
+        return data;
+    }
+    return nullptr;
+}
+
+bool TTarReader::ReadBlock(char* block) {
+    const int count = gzread(static_cast<gzFile>(File), block, BLOCK_SIZE);
+    if (count == 0) {
+        // Archives cut right after the last member are accepted
+        return false;
+    }
+    if (count != static_cast<int>(BLOCK_SIZE)) {
+        throw std::runtime_error("Truncated archive: " + ArchiveName);
+    }
+    return true;
+}
+
+void TTarReader::ReadExactly(char* data, size_t size) {
+    while (size != 0) {
+        const unsigned chunk = std::min<size_t>(size, 1U << 30);
+        const int count = gzread(static_cast<gzFile>(File), data, chunk);
+        if (count <= 0) {
+            throw std::runtime_error("Truncated archive: " + ArchiveName);
+        }
+        data += count;
+        size -= count;
+    }
+}
+
+void TTarReader::Skip(size_t size) {
+    char buffer[BLOCK_SIZE * 16];
+    while (size != 0) {
+        const size_t chunk = std::min(size, sizeof(buffer));
+        ReadExactly(buffer, chunk);
+        size -= chunk;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "file_reader.h"
+
+#include <memory>
+#include <string>
+
+// Checks the extension: .tar, .tar.gz or .tgz
+bool IsTarArchive(const std::string& fileName);
+
+// Streams regular files out of a tar archive, gzip compressed or not, without
+// extracting it. Supports ustar prefixes, GNU long names and pax paths.
+class TTarReader {
+public:
+    // Members are kept in memory until their TFileData objects are destroyed,
+    // Next blocks while they hold more than maxBytesInFlight
+    TTarReader(const std::string& archiveName, size_t maxBytesInFlight = 256 << 20);
+    TTarReader(const TTarReader&) = delete;
+    TTarReader& operator=(const TTarReader&) = delete;
+    ~TTarReader();
+
+    // Returns the next regular file named by its path inside the archive, nullptr at the end
+    TFileDataPtr Next();
+
+private:
+    bool ReadBlock(char* block);
+    void ReadExactly(char* data, size_t size);
+    void Skip(size_t size);
+
+private:
+    const std::string ArchiveName;
+    void* File = nullptr;
+    std::shared_ptr<TReadBudget> Budget;
+    bool IsFinished = false;
+};
@@ -0,0 +1,278 @@
+#include "text_scan.h"
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+bool InRange(unsigned char ch, unsigned char low, unsigned char high) {
+    return static_cast<unsigned char>(ch - low) <= high - low;
+}
+
+bool IsSpace(unsigned char ch) {
+    return ch == ' ' || InRange(ch, '\t', '\r') || ch == 0;
+}
+
+void CountByte(unsigned char ch, unsigned char next, TScriptCounts& counts) {
+    if (InRange(ch | 0x20, 'a', 'z')) {
+        counts.Latin++;
+    } else if (ch == 0xD0) {
+        // Ё, А-Я, а-п
+        if (next == 0x81 || InRange(next, 0x90, 0xBF)) {
+            counts.Russian++;
+            counts.RussianOnly += (next == 0xAB || next == 0xAD);
+        } else {
+            counts.OtherCyrillic++;
+        }
+    } else if (ch == 0xD1) {
+        // р-я, ё
+        if (InRange(next, 0x80, 0x8F) || next == 0x91) {
+            counts.Russian++;
+            counts.RussianOnly += (next == 0x8B || next == 0x8D);
+        } else {
+            counts.OtherCyrillic++;
+        }
+    } else if (InRange(ch, 0xD2, 0xD4)) {
+        counts.OtherCyrillic++;
+    } else if (InRange(ch, 0xC3, 0xCF) || InRange(ch, 0xD5, 0xDF) || InRange(ch, 0xE0, 0xE1) || InRange(ch, 0xE3, 0xEE)) {
+        // C2 is punctuation like «», E2 is punctuation and symbols, EF and 4 bytes are mostly BOM and emoji
+        counts.Other++;
+    }
+}
+
+// Byte by byte UTF-8 validation, continues the block loop
+struct TUtf8State {
+    // Continuation bytes still expected and the range of the next one
+    size_t Pending = 0;
+    unsigned char Low = 0x80;
+    unsigned char High = 0xBF;
+    bool IsValid = true;
+};
+
+void ValidateByte(unsigned char ch, TUtf8State& state) {
+    if (state.Pending != 0) {
+        const bool isExpected = InRange(ch, state.Low, state.High);
+        state.Pending--;
+        state.Low = 0x80;
+        state.High = 0xBF;
+        if (isExpected) {
+            return;
+        }
+        // The byte may still start a character of its own
+        state.IsValid = false;
+        state.Pending = 0;
+    }
+    if (ch < 0x80) {
+        return;
+    }
+    if (InRange(ch, 0xC2, 0xDF)) {
+        state.Pending = 1;
+    } else if (InRange(ch, 0xE0, 0xEF)) {
+        // No overlong forms and no surrogates
+        state.Pending = 2;
+        state.Low = (ch == 0xE0) ? 0xA0 : 0x80;
+        state.High = (ch == 0xED) ? 0x9F : 0xBF;
+    } else if (InRange(ch, 0xF0, 0xF4)) {
+        // No overlong forms and nothing above U+10FFFF
+        state.Pending = 3;
+        state.Low = (ch == 0xF0) ? 0x90 : 0x80;
+        state.High = (ch == 0xF4) ? 0x8F : 0xBF;
+    } else {
+        state.IsValid = false;
+    }
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+const size_t BLOCK_SIZE = 32;
+
+// Bit i of every mask is about the byte i of a block
+struct TBlockMasks {
+    uint32_t Space = 0;
+    uint32_t Continuation = 0;
+    // Leads of two, three and four byte characters
+    uint32_t Lead2 = 0;
+    uint32_t Lead3 = 0;
+    uint32_t Lead4 = 0;
+    // Bytes that never occur in UTF-8 and leads followed by a continuation out of their range
+    uint32_t Invalid = 0;
+    uint32_t Latin = 0;
+    uint32_t Russian = 0;
+    uint32_t RussianOnly = 0;
+    uint32_t OtherCyrillic = 0;
+    uint32_t Other = 0;
+};
+
+#if defined(__AVX2__)
+struct TSimd {
+    using TVector = __m256i;
+    static const size_t SIZE = 32;
+
+    static TVector Load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static TVector Set(unsigned char value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+    static TVector Or(TVector a, TVector b) { return _mm256_or_si256(a, b); }
+    static TVector And(TVector a, TVector b) { return _mm256_and_si256(a, b); }
+    static TVector AndNot(TVector a, TVector b) { return _mm256_andnot_si256(a, b); }
+    static TVector Equal(TVector a, unsigned char value) { return _mm256_cmpeq_epi8(a, Set(value)); }
+    // Unsigned low <= ch <= high for every byte
+    static TVector InRange(TVector ch, unsigned char low, unsigned char high) {
+        const TVector shifted = _mm256_sub_epi8(ch, Set(low));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, Set(high - low)), shifted);
+    }
+    static uint32_t Mask(TVector a) { return static_cast<uint32_t>(_mm256_movemask_epi8(a)); }
+};
+#else
+struct TSimd {
+    using TVector = __m128i;
+    static const size_t SIZE = 16;
+
+    static TVector Load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static TVector Set(unsigned char value) { return _mm_set1_epi8(static_cast<char>(value)); }
+    static TVector Or(TVector a, TVector b) { return _mm_or_si128(a, b); }
+    static TVector And(TVector a, TVector b) { return _mm_and_si128(a, b); }
+    static TVector AndNot(TVector a, TVector b) { return _mm_andnot_si128(a, b); }
+    static TVector Equal(TVector a, unsigned char value) { return _mm_cmpeq_epi8(a, Set(value)); }
+    // Unsigned low <= ch <= high for every byte
+    static TVector InRange(TVector ch, unsigned char low, unsigned char high) {
+        const TVector shifted = _mm_sub_epi8(ch, Set(low));
+        return _mm_cmpeq_epi8(_mm_min_epu8(shifted, Set(high - low)), shifted);
+    }
+    static uint32_t Mask(TVector a) { return static_cast<uint32_t>(_mm_movemask_epi8(a)); }
+};
+#endif
+
+// Fills the bits of SIZE bytes at p starting from the shift, the byte after them is read too
+void ClassifyVector(const char* p, size_t shift, TBlockMasks& masks) {
+    using TVector = TSimd::TVector;
+    const TVector ch = TSimd::Load(p);
+    const TVector next = TSimd::Load(p + 1);
+    auto mask = [shift](TVector v) {
+        return TSimd::Mask(v) << shift;
+    };
+
+    masks.Space |= mask(TSimd::Or(TSimd::Or(TSimd::InRange(ch, '\t', '\r'), TSimd::Equal(ch, ' ')), TSimd::Equal(ch, 0)));
+
+    const TVector continuation = TSimd::InRange(ch, 0x80, 0xBF);
+    const TVector nextContinuation = TSimd::InRange(next, 0x80, 0xBF);
+    masks.Continuation |= mask(continuation);
+    masks.Lead2 |= mask(TSimd::InRange(ch, 0xC2, 0xDF));
+    masks.Lead3 |= mask(TSimd::InRange(ch, 0xE0, 0xEF));
+    masks.Lead4 |= mask(TSimd::InRange(ch, 0xF0, 0xF4));
+    // Overlong forms, surrogates and code points above U+10FFFF are told by the second byte
+    const TVector badSecond = TSimd::Or(
+        TSimd::Or(
+            TSimd::And(TSimd::Equal(ch, 0xE0), TSimd::InRange(next, 0x80, 0x9F)),
+            TSimd::And(TSimd::Equal(ch, 0xED), TSimd::InRange(next, 0xA0, 0xBF))),
+        TSimd::Or(
+            TSimd::And(TSimd::Equal(ch, 0xF0), TSimd::InRange(next, 0x80, 0x8F)),
+            TSimd::And(TSimd::Equal(ch, 0xF4), TSimd::InRange(next, 0x90, 0xBF))));
+    const TVector neverValid = TSimd::Or(TSimd::InRange(ch, 0xC0, 0xC1), TSimd::InRange(ch, 0xF5, 0xFF));
+    masks.Invalid |= mask(TSimd::Or(TSimd::And(badSecond, nextContinuation), neverValid));
+
+    // Same as CountByte
+    const TVector d0 = TSimd::Equal(ch, 0xD0);
+    const TVector d1 = TSimd::Equal(ch, 0xD1);
+    const TVector russian = TSimd::Or(
+        TSimd::And(d0, TSimd::Or(TSimd::Equal(next, 0x81), TSimd::InRange(next, 0x90, 0xBF))),
+        TSimd::And(d1, TSimd::Or(TSimd::InRange(next, 0x80, 0x8F), TSimd::Equal(next, 0x91))));
+    const TVector russianOnly = TSimd::Or(
+        TSimd::And(d0, TSimd::Or(TSimd::Equal(next, 0xAB), TSimd::Equal(next, 0xAD))),
+        TSimd::And(d1, TSimd::Or(TSimd::Equal(next, 0x8B), TSimd::Equal(next, 0x8D))));
+    const TVector otherCyrillic = TSimd::Or(
+        TSimd::AndNot(russian, TSimd::Or(d0, d1)),
+        TSimd::InRange(ch, 0xD2, 0xD4));
+    const TVector other = TSimd::Or(
+        TSimd::Or(TSimd::InRange(ch, 0xC3, 0xCF), TSimd::InRange(ch, 0xD5, 0xDF)),
+        TSimd::Or(TSimd::InRange(ch, 0xE0, 0xE1), TSimd::InRange(ch, 0xE3, 0xEE)));
+    masks.Latin |= mask(TSimd::InRange(TSimd::Or(ch, TSimd::Set(0x20)), 'a', 'z'));
+    masks.Russian |= mask(russian);
+    masks.RussianOnly |= mask(russianOnly);
+    masks.OtherCyrillic |= mask(otherCyrillic);
+    masks.Other |= mask(other);
+}
+
+size_t Count(uint32_t mask) {
+    return __builtin_popcount(mask);
+}
+
+#endif
+
+} // namespace
+
+void ScanText(const char* data, size_t size, TTextScan& scan) {
+    scan.Words.clear();
+    scan.Scripts = TScriptCounts();
+    TScriptCounts& scripts = scan.Scripts;
+    TUtf8State utf8;
+    bool isPrevSpace = true;
+    size_t wordBegin = 0;
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    // Continuation bytes the leads of the previous block expect at the start of this one
+    uint64_t pending = 0;
+    for (; i + BLOCK_SIZE + 1 <= size; i += BLOCK_SIZE) {
+        TBlockMasks masks;
+        for (size_t shift = 0; shift < BLOCK_SIZE; shift += TSimd::SIZE) {
+            ClassifyVector(data + i + shift, shift, masks);
+        }
+
+        // A word starts after a space and ends at the next space
+        const uint32_t prevSpace = (masks.Space << 1) | (isPrevSpace ? 1 : 0);
+        const uint32_t starts = ~masks.Space & prevSpace;
+        uint32_t boundaries = starts | (masks.Space & ~prevSpace);
+        while (boundaries != 0) {
+            const size_t bit = __builtin_ctz(boundaries);
+            boundaries &= boundaries - 1;
+            if (starts & (1u << bit)) {
+                wordBegin = i + bit;
+            } else {
+                scan.Words.emplace_back(wordBegin, i + bit);
+            }
+        }
+        isPrevSpace = masks.Space >> 31;
+
+        // Continuations are exactly the bytes the leads before them expect
+        const uint64_t expected = pending
+            | (static_cast<uint64_t>(masks.Lead2 | masks.Lead3 | masks.Lead4) << 1)
+            | (static_cast<uint64_t>(masks.Lead3 | masks.Lead4) << 2)
+            | (static_cast<uint64_t>(masks.Lead4) << 3);
+        if (static_cast<uint32_t>(expected) != masks.Continuation || masks.Invalid != 0) {
+            utf8.IsValid = false;
+        }
+        pending = expected >> 32;
+
+        scripts.Latin += Count(masks.Latin);
+        scripts.Russian += Count(masks.Russian);
+        scripts.RussianOnly += Count(masks.RussianOnly);
+        scripts.OtherCyrillic += Count(masks.OtherCyrillic);
+        scripts.Other += Count(masks.Other);
+    }
+    // The ranges of second bytes are already checked with the block
+    utf8.Pending = __builtin_popcountll(pending);
+#endif
+    for (; i < size; i++) {
+        const unsigned char ch = data[i];
+        if (IsSpace(ch)) {
+            if (!isPrevSpace) {
+                scan.Words.emplace_back(wordBegin, i);
+            }
+            isPrevSpace = true;
+        } else {
+            if (isPrevSpace) {
+                wordBegin = i;
+            }
+            isPrevSpace = false;
+        }
+        ValidateByte(ch, utf8);
+        CountByte(ch, i + 1 < size ? data[i + 1] : 0, scripts);
+    }
+    if (!isPrevSpace) {
+        scan.Words.emplace_back(wordBegin, size);
+    }
+    scan.IsValidUtf8 = utf8.IsValid;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Letters of the scripts the language detection tells apart, non-ASCII characters are counted once
+struct TScriptCounts {
+    // ASCII letters
+    size_t Latin = 0;
+    // Letters of the Russian alphabet, and separately ы and э that most other Cyrillic alphabets lack
+    size_t Russian = 0;
+    size_t RussianOnly = 0;
+    // Cyrillic letters outside the Russian alphabet: Ukrainian, Serbian, Tajik, Kazakh...
+    size_t OtherCyrillic = 0;
+    // Other non-ASCII characters except punctuation, symbols and emoji
+    size_t Other = 0;
+};
+
+// Everything the fastText inputs need to know about a text, gathered in one pass
+struct TTextScan {
+    // Begin and end offsets of the words the way fastText splits a line, on " \n\r\t\v\f" and NUL
+    std::vector<std::pair<size_t, size_t>> Words;
+    TScriptCounts Scripts;
+    // All complete characters are well-formed UTF-8, the text may still end inside a character
+    bool IsValidUtf8 = true;
+};
+
+// Classifies 32 bytes at a time with AVX2 or SSE2, byte by byte on other targets and for the tail.
+// The words of the previous scan are cleared.
+void ScanText(const char* data, size_t size, TTextScan& scan);
@@ -0,0 +1,119 @@
+#include "token_ids.h"
+#include "text_scan.h"
+
+#include <sstream>
+
+#include <fasttext.h>
+
+namespace {
+
+// Dictionary::addWordNgrams without the pruned index of quantized models
+void AppendWordNgrams(
+    const fasttext::FastText& model,
+    const std::vector<int32_t>& hashes,
+    std::vector<int32_t>& ids)
+{
+    const fasttext::Args args = model.getArgs();
+    const int32_t nwords = model.getDictionary()->nwords();
+    const size_t n = args.wordNgrams;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        // Hashes are signed in fastText, they are sign extended here too
+        uint64_t h = hashes[i];
+        for (size_t j = i + 1; j < hashes.size() && j < i + n; j++) {
+            h = h * 116049371 + hashes[j];
+            ids.push_back(nwords + static_cast<int32_t>(h % args.bucket));
+        }
+    }
+}
+
+} // namespace
+
+TTokenResolver::TTokenResolver(const fasttext::FastText& model, bool addWordNgrams, size_t maxTokens)
+    : Model(model)
+    , Dictionary(model.getDictionary())
+    , AddWordNgrams(addWordNgrams && model.getArgs().wordNgrams > 1)
+    , MaxTokens(maxTokens)
+    , Maxn(model.getArgs().maxn)
+    , IsQuant(model.isQuant())
+{}
+
+void TTokenResolver::Add(const std::string& token) {
+    if (IsFull()) {
+        return;
+    }
+    if (AddWordNgrams && IsQuant) {
+        Line += token;
+        Line += ' ';
+    }
+    if (token.empty()) {
+        return;
+    }
+    const uint32_t h = Dictionary->hash(token);
+    const int32_t id = Dictionary->getId(token, h);
+    const fasttext::entry_type type = id < 0 ? Dictionary->getType(token) : Dictionary->getType(id);
+    if (type != fasttext::entry_type::word) {
+        return;
+    }
+    if (id >= 0) {
+        const std::vector<int32_t>& subwords = Dictionary->getSubwords(id);
+        TokenIds.Ids.insert(TokenIds.Ids.end(), subwords.begin(), subwords.end());
+    } else if (Maxn > 0) {
+        Dictionary->computeSubwords(fasttext::Dictionary::BOW + token + fasttext::Dictionary::EOW, TokenIds.Ids);
+    }
+    TokenIds.Offsets.push_back(TokenIds.Ids.size());
+    Hashes.push_back(static_cast<int32_t>(h));
+}
+
+void TTokenResolver::EndTitle() {
+    TokenIds.TitleSize = TokenIds.Size();
+}
+
+bool TTokenResolver::IsFull() const {
+    return MaxTokens != 0 && TokenIds.Size() >= MaxTokens;
+}
+
+TTokenIds TTokenResolver::Finish() {
+    if (!AddWordNgrams) {
+        return std::move(TokenIds);
+    }
+    if (!IsQuant) {
+        AppendWordNgrams(Model, Hashes, TokenIds.Ids);
+        return std::move(TokenIds);
+    }
+    // Quantization may prune n-grams through an index the dictionary keeps private,
+    // the line is split once more here to get them
+    std::istringstream stream(Line);
+    std::vector<int32_t> lineIds;
+    std::vector<int32_t> labels;
+    Dictionary->getLine(stream, lineIds, labels);
+    if (lineIds.size() > TokenIds.Ids.size()) {
+        TokenIds.Ids.insert(TokenIds.Ids.end(), lineIds.begin() + TokenIds.Ids.size(), lineIds.end());
+    }
+    return std::move(TokenIds);
+}
+
+TTokenIds ResolveTokens(
+    const fasttext::FastText& model,
+    const std::vector<std::string>& titleTokens,
+    const std::vector<std::string>& textTokens,
+    bool addWordNgrams)
+{
+    TTokenResolver resolver(model, addWordNgrams);
+    for (const std::string& token : titleTokens) {
+        resolver.Add(token);
+    }
+    resolver.EndTitle();
+    for (const std::string& token : textTokens) {
+        resolver.Add(token);
+    }
+    return resolver.Finish();
+}
+
+void SplitWords(const std::string& text, std::vector<std::string>& words) {
+    words.clear();
+    TTextScan scan;
+    ScanText(text.data(), text.size(), scan);
+    for (const auto& bounds : scan.Words) {
+        words.emplace_back(text, bounds.first, bounds.second - bounds.first);
+    }
+}
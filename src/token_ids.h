@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fasttext {
+    class FastText;
+    class Dictionary;
+}
+
+// Preprocessed title and text tokens resolved against the dictionary of one fastText model.
+// Subword ids of the i-th token are Ids[Offsets[i], Offsets[i + 1]), the title tokens go first.
+// Word n-gram ids of a classifier follow the subwords, so Ids is the input of FastText::predict.
+struct TTokenIds {
+    std::vector<int32_t> Ids;
+    std::vector<uint32_t> Offsets = std::vector<uint32_t>(1, 0);
+    uint32_t TitleSize = 0;
+
+    size_t Size() const { return Offsets.size() - 1; }
+    bool Empty() const { return Ids.empty(); }
+};
+
+// Resolves tokens as they come, so a text can be tokenized only as far as it is needed.
+// Tokens after the first maxTokens words are ignored, zero means no limit.
+class TTokenResolver {
+public:
+    TTokenResolver(const fasttext::FastText& model, bool addWordNgrams, size_t maxTokens = 0);
+
+    void Add(const std::string& token);
+    // Everything added before is the title
+    void EndTitle();
+    bool IsFull() const;
+    // Adds the word n-grams if asked, the resolver is not usable after it
+    TTokenIds Finish();
+
+private:
+    const fasttext::FastText& Model;
+    const std::shared_ptr<const fasttext::Dictionary> Dictionary;
+    const bool AddWordNgrams;
+    const size_t MaxTokens;
+    const int32_t Maxn;
+    const bool IsQuant;
+    TTokenIds TokenIds;
+    std::vector<int32_t> Hashes;
+    // Tokens joined with spaces for quantized models, see Finish
+    std::string Line;
+};
+
+// Gives the ids Dictionary::getLine gives for the tokens joined with spaces,
+// word n-grams are added only if asked. Every token is hashed once.
+TTokenIds ResolveTokens(
+    const fasttext::FastText& model,
+    const std::vector<std::string>& titleTokens,
+    const std::vector<std::string>& textTokens,
+    bool addWordNgrams);
+
+// Splits the text into words the way fastText reads them, line ends are read as spaces
+void SplitWords(const std::string& text, std::vector<std::string>& words);
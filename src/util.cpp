@@ -1,44 +1,194 @@
+#include <algorithm>
+#include <atomic>
 #include <cmath>
-#include <ctime>
-#include <regex>
+#include <cstring>
+#include <limits>
 
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
 
+#include "thread_pool.h"
 #include "util.h"
 
-void ReadFileNames(const std::string& directory, std::vector<std::string>& fileNames, int nDocs) {
-    boost::filesystem::path dirPath(directory);
-    boost::filesystem::recursive_directory_iterator start(dirPath);
-    boost::filesystem::recursive_directory_iterator end;
-    for (auto it = start; it != end; it++) {
-        if (boost::filesystem::is_directory(it->path())) {
+namespace {
+
+struct TDirectoryListing {
+    struct TEntry {
+        std::string Path;
+        uint64_t Inode = 0;
+        // Index in Subdirectories for directories
+        int Subdirectory = -1;
+    };
+
+    std::vector<TEntry> Entries;
+    std::vector<std::future<std::unique_ptr<TDirectoryListing>>> Subdirectories;
+};
+
+std::unique_ptr<TDirectoryListing> ListDirectory(
+    const boost::filesystem::path& directory,
+    TThreadPool& threadPool,
+    std::shared_ptr<std::atomic<bool>> isCancelled)
+{
+    std::unique_ptr<TDirectoryListing> listing(new TDirectoryListing());
+    if (*isCancelled) {
+        return listing;
+    }
+    std::unique_ptr<DIR, int(*)(DIR*)> dir(::opendir(directory.c_str()), ::closedir);
+    if (!dir) {
+        throw std::runtime_error("Can't open directory: " + directory.string());
+    }
+    while (const dirent* entry = ::readdir(dir.get())) {
+        const char* name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
             continue;
         }
-        std::string path = it->path().string();
-        if (path.substr(path.length() - 5) == ".html") {
-            fileNames.push_back(path);
+        const boost::filesystem::path path = directory / name;
+        bool isDirectory = entry->d_type == DT_DIR;
+        bool isSymlink = entry->d_type == DT_LNK;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat entryStat;
+            if (::lstat(path.c_str(), &entryStat) == 0) {
+                isDirectory = S_ISDIR(entryStat.st_mode);
+                isSymlink = S_ISLNK(entryStat.st_mode);
+            }
+        }
+        TDirectoryListing::TEntry listingEntry;
+        listingEntry.Path = path.string();
+        listingEntry.Inode = entry->d_ino;
+        if (isDirectory) {
+            listingEntry.Subdirectory = listing->Subdirectories.size();
+            listing->Subdirectories.push_back(threadPool.enqueue(ListDirectory, path, std::ref(threadPool), isCancelled));
+        } else if (isSymlink && boost::filesystem::is_directory(path)) {
+            // Links to directories are not followed
+            continue;
+        } else if (!boost::algorithm::ends_with(listingEntry.Path, ".html")) {
+            continue;
         }
-        if (nDocs != -1 && fileNames.size() == static_cast<size_t>(nDocs)) {
+        listing->Entries.push_back(std::move(listingEntry));
+    }
+    return listing;
+}
+
+// Returns false once maxCount files are reported
+bool ReportFileNames(
+    TDirectoryListing& listing,
+    const TFileNameCallback& onFileName,
+    size_t maxCount,
+    bool sortByInode,
+    size_t& count)
+{
+    struct TDelayedFile {
+        uint64_t Inode;
+        size_t Index;
+        const std::string* Path;
+    };
+    std::vector<TDelayedFile> delayedFiles;
+    bool isFinished = false;
+    for (const TDirectoryListing::TEntry& entry : listing.Entries) {
+        if (count == maxCount) {
+            isFinished = true;
             break;
         }
+        if (entry.Subdirectory != -1) {
+            std::unique_ptr<TDirectoryListing> subdirectory = listing.Subdirectories[entry.Subdirectory].get();
+            if (!ReportFileNames(*subdirectory, onFileName, maxCount, sortByInode, count)) {
+                isFinished = true;
+                break;
+            }
+            continue;
+        }
+        if (sortByInode) {
+            delayedFiles.push_back({entry.Inode, count, &entry.Path});
+        } else {
+            onFileName(count, entry.Path);
+        }
+        count++;
     }
+    std::sort(delayedFiles.begin(), delayedFiles.end(), [](const TDelayedFile& f1, const TDelayedFile& f2) {
+        return f1.Inode < f2.Inode;
+    });
+    for (const TDelayedFile& file : delayedFiles) {
+        onFileName(file.Index, *file.Path);
+    }
+    return !isFinished;
 }
 
-std::string GetHost(const std::string& url) {
-    // if u know better way to do it - it would be nice if u rewrite it
-    std::string output = "";
-    // https://stackoverflow.com/questions/2616011/easy-way-to-parse-a-url-in-c-cross-platform
-    try {
-        std::regex ex("(http|https)://(?:www\\.)?([^/ :]+):?([^/ ]*)(/?[^ #?]*)\\x3f?([^ #]*)#?([^ ]*)");
-        std::smatch what;
-        if (std::regex_match(url, what, ex) && what.size() >= 3) {
-            output = std::string(what[2].first, what[2].second);
+bool ParseDigits(const char* s, size_t count, int& value) {
+    value = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
         }
-    } catch (...) {
-        LOG_DEBUG("Can't parse host from url: " << url);
-        return output;
+        value = value * 10 + (s[i] - '0');
     }
-    return output;
+    return true;
+}
+
+// Days from 1970-01-01 to the first day of the month in the proleptic Gregorian calendar,
+// see http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+int64_t DaysFromCivil(int64_t year, int64_t month) {
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t yearOfEra = year - era * 400;
+    const int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5;
+    const int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+} // namespace
+
+void ReadFileNames(const std::string& directory, std::vector<std::string>& fileNames, int nDocs) {
+    TThreadPool threadPool;
+    ReadFileNames(directory, threadPool, [&fileNames](size_t, const std::string& fileName) {
+        fileNames.push_back(fileName);
+    }, nDocs);
+}
+
+void ReadFileNames(
+    const std::string& directory,
+    TThreadPool& threadPool,
+    const TFileNameCallback& onFileName,
+    int nDocs,
+    bool sortByInode)
+{
+    auto isCancelled = std::make_shared<std::atomic<bool>>(false);
+    std::unique_ptr<TDirectoryListing> root = ListDirectory(directory, threadPool, isCancelled);
+    // Any non-positive count used to mean no limit
+    const size_t maxCount = nDocs > 0 ? static_cast<size_t>(nDocs) : std::numeric_limits<size_t>::max();
+    size_t count = 0;
+    ReportFileNames(*root, onFileName, maxCount, sortByInode, count);
+    // Listings nobody is waiting for anymore
+    *isCancelled = true;
+}
+
+std::string GetHost(const std::string& url) {
+    // Same result as matching the whole url against
+    // (http|https)://(?:www\.)?([^/ :]+):?([^/ ]*)(/?[^ #?]*)\x3f?([^ #]*)#?([^ ]*)
+    // and taking the second group. Everything after the scheme matches unless there is a space.
+    size_t begin = 0;
+    if (boost::algorithm::starts_with(url, "http://")) {
+        begin = 7;
+    } else if (boost::algorithm::starts_with(url, "https://")) {
+        begin = 8;
+    } else {
+        return std::string();
+    }
+    if (url.find(' ', begin) != std::string::npos) {
+        return std::string();
+    }
+    // "www." is a part of the host when nothing else is left of it
+    if (url.compare(begin, 4, "www.") == 0
+        && begin + 4 < url.size()
+        && url[begin + 4] != '/'
+        && url[begin + 4] != ':')
+    {
+        begin += 4;
+    }
+    const size_t end = std::min(url.find_first_of("/:", begin), url.size());
+    return end > begin ? url.substr(begin, end - begin) : std::string();
 }
 
 std::string CleanFileName(const std::string& fileName) {
@@ -64,26 +214,46 @@ double Sigmoid(double x) {
 }
 
 uint64_t DateToTimestamp(const std::string& date) {
-    std::regex ex("(\\d\\d\\d\\d)-(\\d\\d)-(\\d\\d)T(\\d\\d):(\\d\\d):(\\d\\d)([+-])(\\d\\d):(\\d\\d)");
-    std::smatch what;
-    if (!std::regex_match(date, what, ex) || what.size() < 10) {
+    uint64_t timestamp = 0;
+    if (!ParseDate(date, timestamp)) {
         throw std::runtime_error("wrong date format");
     }
-    std::tm t = {};
-    t.tm_sec = std::stoi(what[6]);
-    t.tm_min = std::stoi(what[5]);
-    t.tm_hour = std::stoi(what[4]);
-    t.tm_mday = std::stoi(what[3]);
-    t.tm_mon = std::stoi(what[2]) - 1;
-    t.tm_year = std::stoi(what[1]) - 1900;
-
-    time_t timestamp = timegm(&t);
-    uint64_t zone_ts = std::stoi(what[8]) * 60 * 60 + std::stoi(what[9]) * 60;
-    if (what[7] == "+") {
-        timestamp = timestamp - zone_ts;
-    } else if (what[7] == "-") {
-        timestamp = timestamp + zone_ts;
+    return timestamp;
+}
+
+bool ParseDate(const std::string& date, uint64_t& timestamp) {
+    // YYYY-MM-DDThh:mm:ss+hh:mm
+    const char* s = date.c_str();
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    int hour = 0;
+    int minute = 0;
+    int second = 0;
+    int zoneHour = 0;
+    int zoneMinute = 0;
+    if (date.size() != 25
+        || !ParseDigits(s, 4, year) || s[4] != '-'
+        || !ParseDigits(s + 5, 2, month) || s[7] != '-'
+        || !ParseDigits(s + 8, 2, day) || s[10] != 'T'
+        || !ParseDigits(s + 11, 2, hour) || s[13] != ':'
+        || !ParseDigits(s + 14, 2, minute) || s[16] != ':'
+        || !ParseDigits(s + 17, 2, second) || (s[19] != '+' && s[19] != '-')
+        || !ParseDigits(s + 20, 2, zoneHour) || s[22] != ':'
+        || !ParseDigits(s + 23, 2, zoneMinute))
+    {
+        return false;
     }
-    return timestamp > 0 ? timestamp : 0;
+
+    // Fields out of their ranges are carried over the same way timegm does it
+    int64_t monthIndex = month - 1;
+    int64_t fullYear = year + (monthIndex < 0 ? -1 : monthIndex / 12);
+    monthIndex = (monthIndex + 12) % 12;
+    const int64_t days = DaysFromCivil(fullYear, monthIndex + 1) + day - 1;
+    int64_t seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+    const int64_t zone = zoneHour * 3600 + zoneMinute * 60;
+    seconds += (s[19] == '+') ? -zone : zone;
+    timestamp = seconds > 0 ? seconds : 0;
+    return true;
 }
 
@@ -1,18 +1,38 @@
 #pragma once
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <iostream>
 
+class TThreadPool;
+
 #ifdef NDEBUG
 #define LOG_DEBUG(x)
 #else
 #define LOG_DEBUG(x) std::cerr << x << std::endl;
 #endif
 
+// Counters of a run in every build, written only if the stream pointer is set, see --stats
+#define LOG_STATS(stream, x) do { if (stream) { *(stream) << x << std::endl; } } while (false)
+
+// Called with the position of a file in a sequential recursive walk and its name
+using TFileNameCallback = std::function<void(size_t index, const std::string& fileName)>;
+
 // Read names of all files in directory
 void ReadFileNames(const std::string& directory, std::vector<std::string>& fileNames, int nDocs=-1);
 
+// Read names of all files in directory, every subdirectory is listed by its own task on the pool.
+// The callback runs on the calling thread as soon as the files before it are known, so work on the
+// first files can start while the rest of the tree is listed. With sortByInode the files of each
+// directory are reported in inode order, still with their indices from the sequential walk.
+void ReadFileNames(
+    const std::string& directory,
+    TThreadPool& threadPool,
+    const TFileNameCallback& onFileName,
+    int nDocs=-1,
+    bool sortByInode=false);
+
 // Get host from url
 std::string GetHost(const std::string& url);
 
@@ -25,3 +45,5 @@ double Sigmoid(double x);
 
 // ISO 8601 with timezone date to timestamp
 uint64_t DateToTimestamp(const std::string& date);
+// Same without exceptions, false for the wrong format
+bool ParseDate(const std::string& date, uint64_t& timestamp);
@@ -0,0 +1,114 @@
+#define BOOST_TEST_DYN_LINK
+
+#define BOOST_TEST_MODULE "AnnotateModule"
+
+#include "../src/annotate.h"
+#include "../src/thread_pool.h"
+#include "fasttext_model.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+#include <set>
+
+namespace {
+
+nlohmann::json MakeDocument(const std::string& fileName, const std::string& url, const std::string& text) {
+    return nlohmann::json({
+        {"url", url},
+        {"site_name", "site"},
+        {"timestamp", 1},
+        {"title", "новости города"},
+        {"description", ""},
+        {"file_name", fileName},
+        {"text", text},
+    });
+}
+
+void WriteLines(const std::string& path, const std::vector<std::string>& lines) {
+    std::ofstream output(path);
+    for (const std::string& line : lines) {
+        output << line << '\n';
+    }
+}
+
+// Lines of json --output_format jsonl for the JSON Lines input
+std::vector<std::string> AnnotateToJsonLines(
+    const std::string& input,
+    const TModelStorage& models,
+    std::vector<TDocument>& docs)
+{
+    std::vector<std::string> lines;
+    TAnnotateOptions options;
+    options.FromJson = true;
+    options.Level = AL_TEXT;
+    options.OnDocument = [&lines](const TDocument& doc) {
+        lines.push_back(doc.ToJson().dump());
+    };
+    options.OnDuplicate = options.OnDocument;
+    Annotate({input}, models, {"ru"}, docs, options);
+    return lines;
+}
+
+std::set<std::string> GetFileNames(const std::vector<std::string>& lines) {
+    std::set<std::string> fileNames;
+    for (const std::string& line : lines) {
+        fileNames.insert(nlohmann::json::parse(line).at("file_name").get<std::string>());
+    }
+    return fileNames;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( json_lines_duplicates )
+{
+    const boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(root);
+    const std::string firstText = "жители города обсуждают новый парк и летние праздники";
+    const std::string secondText = "в области открыли новую школу для тысячи учеников";
+    // Russian texts are told by their script, the language model is only loaded
+    TrainModel({
+        "__label__ru " + firstText,
+        "__label__en residents of the city discuss the new park"
+    }, (root / "lang.bin").string());
+    TrainModel({
+        "__label__society " + firstText,
+        "__label__society " + secondText
+    }, (root / "cat.bin").string());
+    TThreadPool threadPool;
+    TModelStorage models;
+    models.Load("lang_detect_model", (root / "lang.bin").string(), threadPool);
+    models.Load("ru_cat_detect_model", (root / "cat.bin").string(), threadPool);
+
+    // 2 is a copy of 0 by the url, 3 of 1 by the text
+    const std::string inputName = (root / "input.jsonl").string();
+    WriteLines(inputName, {
+        MakeDocument("0.html", "https://a.ru/1", firstText).dump(),
+        MakeDocument("1.html", "https://b.ru/1", secondText).dump(),
+        MakeDocument("2.html", "https://a.ru/1", firstText + " вечером").dump(),
+        MakeDocument("3.html", "https://c.ru/1", secondText).dump()
+    });
+    std::vector<TDocument> docs;
+    const std::vector<std::string> lines = AnnotateToJsonLines(inputName, models, docs);
+    BOOST_REQUIRE_EQUAL(docs.size(), 2);
+    BOOST_REQUIRE_EQUAL(lines.size(), 4);
+    // The copies come after their documents were printed, each of them gets a line
+    BOOST_CHECK((GetFileNames(lines) == std::set<std::string>{"0.html", "1.html", "2.html", "3.html"}));
+    BOOST_CHECK_EQUAL(nlohmann::json::parse(lines[2]).at("duplicate_of").get<std::string>(), "0.html");
+    BOOST_CHECK_EQUAL(nlohmann::json::parse(lines[3]).at("duplicate_of").get<std::string>(), "1.html");
+
+    // The output read back folds the copies into their documents again
+    const std::string outputName = (root / "output.jsonl").string();
+    WriteLines(outputName, lines);
+    std::vector<TDocument> restored;
+    const std::vector<std::string> restoredLines = AnnotateToJsonLines(outputName, models, restored);
+    BOOST_REQUIRE_EQUAL(restored.size(), 2);
+    BOOST_CHECK_EQUAL(restored[0].FileName, "0.html");
+    BOOST_CHECK((restored[0].DuplicateFileNames == std::vector<std::string>{"2.html"}));
+    BOOST_CHECK_EQUAL(restored[1].FileName, "1.html");
+    BOOST_CHECK((restored[1].DuplicateFileNames == std::vector<std::string>{"3.html"}));
+    BOOST_CHECK(restoredLines == lines);
+
+    boost::filesystem::remove_all(root);
+}
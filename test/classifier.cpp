@@ -0,0 +1,268 @@
+#define BOOST_TEST_DYN_LINK
+
+#define BOOST_TEST_MODULE "ClassifierModule"
+
+#include "../src/classifier.h"
+#include "../src/detect.h"
+#include "../src/text_scan.h"
+#include "../src/token_ids.h"
+#include "fasttext_model.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+
+namespace {
+
+// Well-formed UTF-8 by the table of the Unicode standard, an unfinished last character is allowed
+bool IsValidUtf8(const std::string& text) {
+    size_t i = 0;
+    while (i < text.size()) {
+        const unsigned char ch = text[i];
+        size_t length = 1;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (ch < 0x80) {
+            length = 1;
+        } else if (ch >= 0xC2 && ch <= 0xDF) {
+            length = 2;
+        } else if (ch >= 0xE0 && ch <= 0xEF) {
+            length = 3;
+            low = ch == 0xE0 ? 0xA0 : 0x80;
+            high = ch == 0xED ? 0x9F : 0xBF;
+        } else if (ch >= 0xF0 && ch <= 0xF4) {
+            length = 4;
+            low = ch == 0xF0 ? 0x90 : 0x80;
+            high = ch == 0xF4 ? 0x8F : 0xBF;
+        } else {
+            return false;
+        }
+        for (size_t j = 1; j < length; j++) {
+            if (i + j == text.size()) {
+                return true;
+            }
+            const unsigned char next = text[i + j];
+            if (next < (j == 1 ? low : 0x80) || next > (j == 1 ? high : 0xBF)) {
+                return false;
+            }
+        }
+        i += length;
+    }
+    return true;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( predict )
+{
+    std::mt19937 generator(42);
+    const std::vector<std::string> labels = {"sports", "economy", "technology"};
+    const std::vector<std::vector<std::string>> labelWords = {
+        {"match", "goal", "team", "coach", "league", "score", "player", "season"},
+        {"bank", "market", "oil", "price", "rate", "budget", "inflation", "stocks"},
+        {"phone", "chip", "software", "startup", "robot", "app", "cloud", "laptop"}
+    };
+    const std::vector<std::string> commonWords = {"the", "new", "today", "said", "year", "city"};
+    auto makeLine = [&](size_t label, size_t length) {
+        std::string line;
+        for (size_t i = 0; i < length; i++) {
+            const std::vector<std::string>& words = generator() % 3 == 0 ? commonWords : labelWords[label];
+            line += (i == 0 ? "" : " ") + words[generator() % words.size()];
+        }
+        return line;
+    };
+    std::vector<std::string> trainLines;
+    for (size_t i = 0; i < 300; i++) {
+        const size_t label = i % labels.size();
+        trainLines.push_back("__label__" + labels[label] + " " + makeLine(label, 3 + generator() % 10));
+    }
+    const boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(root);
+    const std::string modelPath = (root / "model.bin").string();
+    TrainModel(trainLines, modelPath);
+    fasttext::FastText model;
+    model.loadModel(modelPath);
+
+    const TFastTextClassifier classifier(model);
+    std::vector<std::string> expectedLabels = labels;
+    std::sort(expectedLabels.begin(), expectedLabels.end());
+    std::vector<std::string> classifierLabels = classifier.GetLabels();
+    std::sort(classifierLabels.begin(), classifierLabels.end());
+    BOOST_CHECK(classifierLabels == expectedLabels);
+    // The same layers given as matrices
+    const std::shared_ptr<const fasttext::DenseMatrix> input = model.getInputMatrix();
+    const std::shared_ptr<const fasttext::DenseMatrix> output = model.getOutputMatrix();
+    const TFastTextClassifier matrixClassifier(
+        Eigen::Map<const TFastTextClassifier::TMatrix>(input->data(), input->rows(), input->cols()),
+        Eigen::Map<const TFastTextClassifier::TMatrix>(output->data(), output->rows(), output->cols()),
+        classifier.GetLabels());
+
+    // Mixed topics and unknown words give unsure predictions, an empty line gives none
+    std::vector<std::string> lines = {"", "unknown words only", "goal bank chip"};
+    for (size_t i = 0; i < 200; i++) {
+        std::string line = makeLine(generator() % labels.size(), 1 + generator() % 8);
+        if (i % 2 == 1) {
+            line += " " + makeLine(generator() % labels.size(), 1 + generator() % 8);
+        }
+        lines.push_back(line);
+    }
+    std::vector<TTokenIds> tokenIds;
+    std::vector<std::string> words;
+    for (const std::string& line : lines) {
+        SplitWords(line, words);
+        tokenIds.push_back(ResolveTokens(model, {}, words, /* addWordNgrams = */ true));
+    }
+    std::vector<const std::vector<int32_t>*> batch;
+    for (const TTokenIds& ids : tokenIds) {
+        batch.push_back(&ids.Ids);
+    }
+    for (float threshold : {0.0f, 0.4f, 0.6f}) {
+        size_t predictedCount = 0;
+        const std::vector<TFastTextPrediction> predictions = classifier.Predict(batch, threshold);
+        const std::vector<TFastTextPrediction> matrixPredictions = matrixClassifier.Predict(batch, threshold);
+        BOOST_REQUIRE_EQUAL(predictions.size(), lines.size());
+        BOOST_REQUIRE_EQUAL(matrixPredictions.size(), lines.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            std::istringstream stream(lines[i]);
+            std::vector<std::pair<fasttext::real, std::string>> expected;
+            model.predictLine(stream, expected, 1, threshold);
+            if (expected.empty()) {
+                BOOST_CHECK_EQUAL(predictions[i].Label, -1);
+            } else {
+                BOOST_REQUIRE_GE(predictions[i].Label, 0);
+                BOOST_CHECK_EQUAL("__label__" + classifier.GetLabels()[predictions[i].Label], expected[0].second);
+                BOOST_CHECK_CLOSE(predictions[i].Probability, expected[0].first, 1e-3);
+                predictedCount++;
+            }
+            BOOST_CHECK_EQUAL(matrixPredictions[i].Label, predictions[i].Label);
+            BOOST_CHECK_CLOSE(matrixPredictions[i].Probability, predictions[i].Probability, 1e-3);
+            const TFastTextPrediction single = classifier.Predict(tokenIds[i].Ids, threshold);
+            BOOST_CHECK_EQUAL(single.Label, predictions[i].Label);
+            BOOST_CHECK_EQUAL(single.Probability, predictions[i].Probability);
+        }
+        BOOST_CHECK_GT(predictedCount, 0);
+        if (threshold > 0.0f) {
+            BOOST_CHECK_LT(predictedCount, lines.size());
+        }
+    }
+    BOOST_CHECK(classifier.Predict(std::vector<const std::vector<int32_t>*>(), 0.0f).empty());
+    boost::filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE( split_words )
+{
+    std::vector<std::string> words;
+    SplitWords(" Заголовок,  text\nwith\r\nline\tends ", words);
+    BOOST_CHECK((words == std::vector<std::string>{"Заголовок,", "text", "with", "line", "ends"}));
+    SplitWords("", words);
+    BOOST_CHECK(words.empty());
+    SplitWords("one", words);
+    BOOST_CHECK((words == std::vector<std::string>{"one"}));
+}
+
+BOOST_AUTO_TEST_CASE( scan_text )
+{
+    std::mt19937 generator(42);
+    const std::vector<std::string> pieces = {
+        "a", "Z", "7", "й", "ы", "і", "中", "😀", " ", "\n", "\r\n", "\t", std::string(1, '\0'),
+        // Overlong, surrogate, out of range and lone bytes
+        "\xC0\xAF", "\xE0\x80\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF5", "\x80", "\xD0", "\xE2\x80", "\xFF"};
+    TTextScan scan;
+    std::vector<std::string> words;
+    size_t invalidCount = 0;
+    for (size_t iteration = 0; iteration < 2000; iteration++) {
+        std::string text;
+        const size_t length = generator() % 100;
+        // Half of the texts are left valid
+        const size_t pieceCount = iteration % 2 == 0 ? 13 : pieces.size();
+        for (size_t i = 0; i < length; i++) {
+            text += pieces[generator() % pieceCount];
+        }
+        ScanText(text.data(), text.size(), scan);
+        BOOST_CHECK_EQUAL(scan.IsValidUtf8, IsValidUtf8(text));
+        invalidCount += !scan.IsValidUtf8;
+
+        std::vector<std::string> expected;
+        std::string word;
+        for (const char ch : text + " ") {
+            if (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t' || ch == '\v' || ch == '\f' || ch == '\0') {
+                if (!word.empty()) {
+                    expected.push_back(word);
+                }
+                word.clear();
+            } else {
+                word += ch;
+            }
+        }
+        SplitWords(text, words);
+        BOOST_CHECK(words == expected);
+
+        const TScriptCounts counts = CountScripts(text.data(), text.size());
+        BOOST_CHECK_EQUAL(scan.Scripts.Latin, counts.Latin);
+        BOOST_CHECK_EQUAL(scan.Scripts.Russian, counts.Russian);
+        BOOST_CHECK_EQUAL(scan.Scripts.Other, counts.Other);
+    }
+    BOOST_CHECK_GT(invalidCount, 0);
+
+    // A character cut at the end is not an error
+    ScanText("\xD0", 1, scan);
+    BOOST_CHECK(scan.IsValidUtf8);
+    BOOST_CHECK(!DetectLanguageByScripts("Путин провел совещание с членами правительства\xFF"));
+}
+
+BOOST_AUTO_TEST_CASE( detect_language_by_scripts )
+{
+    const std::string russian = "Путин провел совещание с членами правительства. Обсуждались вопросы экономики и бюджета";
+    BOOST_CHECK_EQUAL(DetectLanguageByScripts(russian).get_value_or(""), "ru");
+    BOOST_CHECK_EQUAL(DetectLanguageByScripts("«Яндекс» представил Alice 2.0 — голосового помощника для дома 😀 " + russian).get_value_or(""), "ru");
+    const std::string english = "The president met with members of the government to discuss the budget";
+    BOOST_CHECK_EQUAL(DetectLanguageByScripts(english).get_value_or(""), "en");
+    BOOST_CHECK_EQUAL(DetectLanguageByScripts("“" + english + "” — Reuters").get_value_or(""), "en");
+
+    // Left to the model
+    BOOST_CHECK(!DetectLanguageByScripts("Путин"));
+    BOOST_CHECK(!DetectLanguageByScripts("Президент України провів нараду з членами уряду щодо бюджету"));
+    BOOST_CHECK(!DetectLanguageByScripts("Президентът се срещна с членовете на правителството за бюджета"));
+    BOOST_CHECK(!DetectLanguageByScripts("Президенти Тоҷикистон бо аъзои ҳукумат мулоқот кард ва буҷаро муҳокима намуд"));
+    BOOST_CHECK(!DetectLanguageByScripts("Le président a rencontré les membres du gouvernement pour discuter du budget"));
+    BOOST_CHECK(!DetectLanguageByScripts("De president sprak met de leden van de regering over de begroting"));
+    // English words in other languages, or one of them repeated
+    BOOST_CHECK(!DetectLanguageByScripts("Het was een lange dag of niet, het was koud en de trein was te laat"));
+    BOOST_CHECK(!DetectLanguageByScripts("Was ist das, was der Minister gestern im Parlament gesagt hat"));
+    BOOST_CHECK(!DetectLanguageByScripts("Det er viktig for regjeringen, og for folk som bor i byen"));
+    BOOST_CHECK(!DetectLanguageByScripts("The the the president of Russia"));
+    BOOST_CHECK(!DetectLanguageByScripts("The president met with 政府 members to discuss the budget of the year"));
+    BOOST_CHECK(!DetectLanguageByScripts(english + " " + russian));
+
+    // The vectorized loop agrees with the byte by byte one on every split of the text
+    std::mt19937 generator(42);
+    const std::vector<std::string> pieces = {"a", "Z", "й", "Ё", "ё", "ы", "Э", "і", "ї", "ҷ", "é", "ß", "中", "—", "«", "😀", " ", "7"};
+    for (size_t iteration = 0; iteration < 200; iteration++) {
+        std::string text;
+        TScriptCounts expected;
+        const size_t length = generator() % 100;
+        for (size_t i = 0; i < length; i++) {
+            const std::string piece = pieces[generator() % pieces.size()];
+            const TScriptCounts counts = CountScripts(piece.data(), piece.size());
+            expected.Latin += counts.Latin;
+            expected.Russian += counts.Russian;
+            expected.RussianOnly += counts.RussianOnly;
+            expected.OtherCyrillic += counts.OtherCyrillic;
+            expected.Other += counts.Other;
+            text += piece;
+        }
+        const TScriptCounts counts = CountScripts(text.data(), text.size());
+        BOOST_CHECK_EQUAL(counts.Latin, expected.Latin);
+        BOOST_CHECK_EQUAL(counts.Russian, expected.Russian);
+        BOOST_CHECK_EQUAL(counts.RussianOnly, expected.RussianOnly);
+        BOOST_CHECK_EQUAL(counts.OtherCyrillic, expected.OtherCyrillic);
+        BOOST_CHECK_EQUAL(counts.Other, expected.Other);
+    }
+    const TScriptCounts counts = CountScripts(russian.data(), russian.size());
+    BOOST_CHECK_EQUAL(counts.Latin, 0);
+    BOOST_CHECK_EQUAL(counts.RussianOnly, 2);
+    BOOST_CHECK_EQUAL(counts.Other + counts.OtherCyrillic, 0);
+}
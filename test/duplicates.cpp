@@ -0,0 +1,147 @@
+#define BOOST_TEST_DYN_LINK
+
+#define BOOST_TEST_MODULE "DuplicatesModule"
+
+#include "../src/document.h"
+#include "../src/duplicates.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+TDocument MakeDocument(const std::string& fileName, const std::string& url, const std::string& text) {
+    TDocument doc;
+    doc.FileName = fileName;
+    doc.Url = url;
+    doc.Text = text;
+    return doc;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( fingerprints )
+{
+    const uint64_t fingerprint = GetTextFingerprint("Breaking news: the Text of an article");
+    BOOST_CHECK_NE(fingerprint, 0);
+    BOOST_CHECK_EQUAL(GetTextFingerprint("  breaking NEWS:\tthe text\n\nof an   article \r\n"), fingerprint);
+    BOOST_CHECK_NE(GetTextFingerprint("Breaking news: the Text of an article!"), fingerprint);
+    BOOST_CHECK_NE(GetTextFingerprint("Breakingnews: the Text of an article"), fingerprint);
+    BOOST_CHECK_NE(GetTextFingerprint("Текст статьи"), GetTextFingerprint("текст статьи"));
+    BOOST_CHECK_EQUAL(GetTextFingerprint(""), 0);
+    BOOST_CHECK_EQUAL(GetTextFingerprint(" \n\t "), 0);
+
+    BOOST_CHECK_EQUAL(GetUrlFingerprint(""), 0);
+    BOOST_CHECK_EQUAL(GetUrlFingerprint("https://a.ru/1"), GetUrlFingerprint("https://a.ru/1"));
+    BOOST_CHECK_NE(GetUrlFingerprint("https://a.ru/1"), GetUrlFingerprint("https://a.ru/2"));
+}
+
+BOOST_AUTO_TEST_CASE( duplicates )
+{
+    // 0 and 2 share the url, 3 is a syndicated copy of 1, 4 of 2 by text
+    const std::vector<TDocument> input = {
+        MakeDocument("0.html", "https://a.ru/1", "First text"),
+        MakeDocument("1.html", "https://b.ru/1", "Second text"),
+        MakeDocument("2.html", "https://a.ru/1", "First text, updated"),
+        MakeDocument("3.html", "https://c.ru/1", "second  TEXT"),
+        MakeDocument("4.html", "", "First text, updated"),
+        MakeDocument("5.html", "https://d.ru/1", "Third text"),
+        MakeDocument("6.html", "https://d.ru/2", "Third text"),
+    };
+    // 5 is not saved, so its copy is dropped too
+    const std::vector<bool> isSaved = {true, true, true, true, true, false, true};
+
+    std::mt19937 generator(42);
+    std::vector<size_t> claimOrder(input.size());
+    for (size_t i = 0; i < claimOrder.size(); i++) {
+        claimOrder[i] = i;
+    }
+    for (size_t iteration = 0; iteration < 20; iteration++) {
+        // Whichever copy is claimed first, the result is the same
+        std::shuffle(claimOrder.begin(), claimOrder.end(), generator);
+        TDuplicateFilter filter;
+        std::vector<TDocument> claimed = input;
+        std::vector<bool> isFirst(input.size());
+        for (size_t i : claimOrder) {
+            isFirst[i] = filter.Claim(claimed[i], i);
+        }
+        // The first copies always win, later ones only lose to copies claimed before them
+        BOOST_CHECK(isFirst[0] && isFirst[1] && isFirst[5]);
+        const size_t position1 = std::find(claimOrder.begin(), claimOrder.end(), 1) - claimOrder.begin();
+        const size_t position3 = std::find(claimOrder.begin(), claimOrder.end(), 3) - claimOrder.begin();
+        BOOST_CHECK_EQUAL(isFirst[3], position3 < position1);
+
+        TDuplicateFolder folder;
+        std::vector<TDocument> docs;
+        for (size_t i = 0; i < claimed.size(); i++) {
+            TDocument& doc = claimed[i];
+            if (folder.Fold(doc, docs)) {
+                continue;
+            }
+            if (!isSaved[i]) {
+                folder.Add(doc, TDuplicateFolder::NOT_SAVED);
+                continue;
+            }
+            docs.push_back(doc);
+            folder.Add(docs.back(), docs.size() - 1);
+        }
+        BOOST_REQUIRE_EQUAL(docs.size(), 2);
+        BOOST_CHECK_EQUAL(docs[0].FileName, "0.html");
+        BOOST_CHECK((docs[0].DuplicateFileNames == std::vector<std::string>{"2.html", "4.html"}));
+        BOOST_CHECK_EQUAL(docs[1].FileName, "1.html");
+        BOOST_CHECK((docs[1].DuplicateFileNames == std::vector<std::string>{"3.html"}));
+        BOOST_CHECK_EQUAL(folder.GetFoldedCount(), 3);
+        BOOST_CHECK_EQUAL(folder.GetDroppedCount(), 1);
+    }
+
+    // Folded file names survive the json output
+    TDocument doc = MakeDocument("data/0.html", "https://a.ru/1", "First text");
+    doc.DuplicateFileNames = {"data/2.html"};
+    const TDocument restored(doc.ToJson());
+    BOOST_CHECK((restored.DuplicateFileNames == std::vector<std::string>{"2.html"}));
+}
+
+BOOST_AUTO_TEST_CASE( duplicates_by_file_name )
+{
+    // Copies printed on their own by JSON Lines are folded by the file name of their document
+    TDuplicateFolder folder;
+    std::vector<TDocument> docs;
+    TDocument original = MakeDocument("0.html", "https://a.ru/1", "First text");
+    original.UrlHash = GetUrlFingerprint(original.Url);
+    original.TextHash = GetTextFingerprint(original.Text);
+    BOOST_CHECK(!folder.Fold(original, docs));
+    docs.push_back(original);
+    folder.Add(docs.back(), 0);
+
+    TDocument copy;
+    copy.FileName = "data/2.html";
+    copy.DuplicateOf = "data/0.html";
+    const TDocument restoredCopy(copy.ToJson());
+    BOOST_CHECK_EQUAL(restoredCopy.FileName, "2.html");
+    BOOST_CHECK_EQUAL(restoredCopy.DuplicateOf, "0.html");
+    BOOST_CHECK(restoredCopy.Url.empty());
+
+    TDocument folded = restoredCopy;
+    size_t position = TDuplicateFolder::NOT_SAVED;
+    BOOST_CHECK(folder.Fold(folded, docs, &position));
+    BOOST_CHECK_EQUAL(position, 0);
+    BOOST_CHECK((docs[0].DuplicateFileNames == std::vector<std::string>{"2.html"}));
+
+    // A copy of the copy is still a copy of the document
+    TDocument second;
+    second.FileName = "4.html";
+    second.DuplicateOf = "2.html";
+    BOOST_CHECK(folder.Fold(second, docs, &position));
+    BOOST_CHECK_EQUAL(position, 0);
+    BOOST_CHECK((docs[0].DuplicateFileNames == std::vector<std::string>{"2.html", "4.html"}));
+
+    TDocument unknown;
+    unknown.FileName = "5.html";
+    unknown.DuplicateOf = "1.html";
+    BOOST_CHECK(folder.Fold(unknown, docs, &position));
+    BOOST_CHECK(position == TDuplicateFolder::NOT_SAVED);
+    BOOST_CHECK_EQUAL(folder.GetFoldedCount(), 2);
+    BOOST_CHECK_EQUAL(folder.GetDroppedCount(), 1);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fasttext.h>
+
+// Trains a small supervised model on the lines, each of them starts with its __label__,
+// and saves it to the path. One thread keeps the result the same from run to run.
+inline void TrainModel(const std::vector<std::string>& lines, const std::string& path) {
+    const std::string inputPath = path + ".txt";
+    {
+        std::ofstream input(inputPath);
+        for (const std::string& line : lines) {
+            input << line << '\n';
+        }
+    }
+    fasttext::Args args;
+    args.input = inputPath;
+    args.output = path;
+    args.model = fasttext::model_name::sup;
+    args.loss = fasttext::loss_name::softmax;
+    args.minCount = 1;
+    args.minn = 0;
+    args.maxn = 0;
+    args.wordNgrams = 2;
+    args.bucket = 1000;
+    args.dim = 10;
+    args.lr = 0.5;
+    args.epoch = 50;
+    args.thread = 1;
+    args.verbose = 0;
+    fasttext::FastText fastText;
+    fastText.train(args);
+    fastText.saveModel(path);
+}
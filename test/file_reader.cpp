@@ -0,0 +1,100 @@
+#define BOOST_TEST_DYN_LINK
+
+#define BOOST_TEST_MODULE "FileReaderModule"
+
+#include "../src/file_reader.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+#include <map>
+#include <random>
+
+BOOST_AUTO_TEST_CASE( file_reader )
+{
+    const boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(root);
+    std::mt19937 generator(42);
+    std::map<std::string, std::string> expected;
+    uint64_t totalSize = 0;
+    for (size_t i = 0; i < 200; i++) {
+        // Some files are larger than the whole budget below
+        const size_t size = (i % 50 == 0) ? 100000 : generator() % 5000;
+        std::string content(size, '\0');
+        for (char& ch : content) {
+            ch = static_cast<char>(generator());
+        }
+        const std::string fileName = (root / (std::to_string(i) + ".html")).string();
+        std::ofstream(fileName, std::ios::binary) << content;
+        expected[fileName] = content;
+        totalSize += size;
+    }
+    const std::string missingFileName = (root / "missing.html").string();
+    const std::string directoryName = root.string();
+
+    for (EReadMethod method : {RM_IO_URING, RM_PREAD}) {
+        TFileReader reader(method, /* maxBytesInFlight = */ 20000, /* queueDepth = */ 8);
+        std::mutex mutex;
+        std::map<std::string, boost::optional<std::string>> results;
+        auto onRead = [&](TFileDataPtr data) {
+            std::unique_lock<std::mutex> lock(mutex);
+            boost::optional<std::string> content;
+            if (data->IsRead()) {
+                content = std::string(data->Data(), data->Size());
+            }
+            BOOST_REQUIRE(results.emplace(data->GetFileName(), content).second);
+        };
+        for (const auto& pair : expected) {
+            reader.Read(pair.first, onRead);
+        }
+        reader.Read(missingFileName, onRead);
+        reader.Read(directoryName, onRead);
+        reader.Finish();
+        BOOST_REQUIRE_EQUAL(results.size(), expected.size() + 2);
+        BOOST_REQUIRE(!results.at(missingFileName));
+        BOOST_REQUIRE(!results.at(directoryName));
+        for (const auto& pair : expected) {
+            BOOST_REQUIRE(results.at(pair.first));
+            BOOST_REQUIRE(results.at(pair.first).get() == pair.second);
+        }
+        BOOST_REQUIRE_EQUAL(reader.GetBytesRead(), totalSize);
+    }
+
+    // A throwing callback does not stop the reader, Finish rethrows its error once every file is handed over
+    for (EReadMethod method : {RM_IO_URING, RM_PREAD}) {
+        TFileReader reader(method, /* maxBytesInFlight = */ 20000, /* queueDepth = */ 8);
+        std::atomic<size_t> count(0);
+        for (const auto& pair : expected) {
+            reader.Read(pair.first, [&](TFileDataPtr) {
+                if (count++ % 10 == 0) {
+                    throw std::runtime_error("callback failed");
+                }
+            });
+        }
+        BOOST_CHECK_THROW(reader.Finish(), std::runtime_error);
+        BOOST_CHECK_EQUAL(count, expected.size());
+        reader.Finish();
+    }
+
+    // Large files are read only up to the limit
+    for (EReadMethod method : {RM_IO_URING, RM_PREAD}) {
+        const size_t maxFileBytes = 3000;
+        TFileReader reader(method, /* maxBytesInFlight = */ 20000, /* queueDepth = */ 8, maxFileBytes);
+        std::mutex mutex;
+        uint64_t expectedSize = 0;
+        for (const auto& pair : expected) {
+            expectedSize += std::min(pair.second.size(), maxFileBytes);
+            reader.Read(pair.first, [&](TFileDataPtr data) {
+                std::unique_lock<std::mutex> lock(mutex);
+                BOOST_REQUIRE(data->IsRead());
+                const std::string& content = expected.at(data->GetFileName());
+                BOOST_REQUIRE(std::string(data->Data(), data->Size()) == content.substr(0, maxFileBytes));
+            });
+        }
+        reader.Finish();
+        BOOST_REQUIRE_EQUAL(reader.GetBytesRead(), expectedSize);
+    }
+    boost::filesystem::remove_all(root);
+}
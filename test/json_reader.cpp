@@ -0,0 +1,95 @@
+#define BOOST_TEST_DYN_LINK
+
+#define BOOST_TEST_MODULE "JsonReaderModule"
+
+#include "../src/document.h"
+#include "../src/json_reader.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <random>
+#include <sstream>
+
+namespace {
+
+std::vector<nlohmann::json> ReadElements(const std::string& input) {
+    std::istringstream stream(input);
+    std::vector<nlohmann::json> elements;
+    ReadJsonArray(stream, [&elements](nlohmann::json&& element) {
+        elements.push_back(std::move(element));
+    });
+    return elements;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( read_json_array )
+{
+    const std::string input = R"([
+        {"url": "https://a.ru/1", "site_name": "A", "timestamp": 1586000000, "title": "Té", "description": "",
+         "text": "Text", "out_links": ["x", "y"], "nested": {"a": [1, [2, 3], {"b": null}], "c": -1.5e3}},
+        [], {}, 1, "str", true, null, [[{"k": [[]]}], 18446744073709551615]
+    ])";
+    const nlohmann::json expected = nlohmann::json::parse(input);
+    const std::vector<nlohmann::json> elements = ReadElements(input);
+    BOOST_REQUIRE_EQUAL(elements.size(), expected.size());
+    for (size_t i = 0; i < elements.size(); i++) {
+        BOOST_CHECK_EQUAL(elements[i], expected[i]);
+    }
+
+    TDocument doc(elements[0]);
+    BOOST_CHECK_EQUAL(doc.Url, "https://a.ru/1");
+    BOOST_CHECK_EQUAL(doc.OutLinks.size(), 2);
+
+    BOOST_CHECK(ReadElements("[]").empty());
+    BOOST_CHECK_THROW(ReadElements("{}"), std::runtime_error);
+    BOOST_CHECK_THROW(ReadElements("1"), std::runtime_error);
+    BOOST_CHECK_THROW(ReadElements("[{\"a\": 1}"), std::runtime_error);
+    BOOST_CHECK_THROW(ReadElements("[1] 2"), std::runtime_error);
+    BOOST_CHECK_THROW(ReadElements(""), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( read_json_lines )
+{
+    std::mt19937 generator(42);
+    std::string input;
+    std::vector<nlohmann::json> expected;
+    for (size_t i = 0; i < 300; i++) {
+        nlohmann::json element = {{"index", i}, {"text", std::string(generator() % 200, 'a')}};
+        if (i % 3 == 0) {
+            element["nested"] = {{"line", "with\nescaped newline"}};
+        }
+        input += element.dump();
+        input += (i % 7 == 0) ? "\r\n" : "\n";
+        if (i % 11 == 0) {
+            input += "  \n\n";
+        }
+        expected.push_back(std::move(element));
+    }
+    // No newline after the last line
+    input += "[1, 2]";
+    expected.push_back({1, 2});
+
+    for (size_t chunksCount : {1, 2, 3, 7, 16, 1000, 100000}) {
+        const auto chunks = SplitByLines(input.data(), input.size(), chunksCount);
+        BOOST_CHECK_LE(chunks.size(), chunksCount);
+        std::vector<nlohmann::json> elements;
+        size_t position = 0;
+        for (const auto& chunk : chunks) {
+            BOOST_CHECK_EQUAL(chunk.first, position);
+            BOOST_CHECK(chunk.second == input.size() || input[chunk.second - 1] == '\n');
+            position = chunk.second;
+            ReadJsonLines(input.data() + chunk.first, input.data() + chunk.second, [&elements](nlohmann::json&& element) {
+                elements.push_back(std::move(element));
+            });
+        }
+        BOOST_CHECK_EQUAL(position, input.size());
+        BOOST_CHECK(elements == expected);
+    }
+    BOOST_CHECK(SplitByLines(input.data(), 0, 4).empty());
+
+    const std::string broken = "{\"a\": 1}\n{\"a\": \n";
+    BOOST_CHECK_THROW(ReadJsonLines(broken.data(), broken.data() + broken.size(), [](nlohmann::json&&) {}), std::runtime_error);
+    BOOST_CHECK(IsJsonLines("data/docs.jsonl"));
+    BOOST_CHECK(!IsJsonLines("data/docs.json"));
+}
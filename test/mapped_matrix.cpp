@@ -0,0 +1,76 @@
+#define BOOST_TEST_DYN_LINK
+
+#define BOOST_TEST_MODULE "MappedMatrixModule"
+
+#include "../src/embedder.h"
+#include "../src/mapped_matrix.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+#include <random>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE( mapped_matrix )
+{
+    const boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(root);
+    const std::string fileName = (root / "matrix.bin").string();
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    const size_t rows = 37;
+    const size_t cols = 11;
+    std::vector<float> data(rows * cols);
+    for (float& value : data) {
+        value = distribution(generator);
+    }
+    BOOST_REQUIRE(TMappedMatrix::Save(fileName, data.data(), rows, cols));
+
+    TMappedMatrix matrix;
+    BOOST_REQUIRE(matrix.Open(fileName));
+    BOOST_CHECK_EQUAL(matrix.Rows(), rows);
+    BOOST_CHECK_EQUAL(matrix.Cols(), cols);
+    for (size_t i = 0; i < rows; i++) {
+        BOOST_CHECK_EQUAL_COLLECTIONS(matrix.Row(i), matrix.Row(i) + cols, data.data() + i * cols, data.data() + (i + 1) * cols);
+    }
+
+    // Truncated files and files of other formats are refused
+    boost::filesystem::resize_file(fileName, boost::filesystem::file_size(fileName) - sizeof(float));
+    BOOST_CHECK(!matrix.Open(fileName));
+    std::ofstream(fileName, std::ios::binary) << std::string(128, 'x');
+    BOOST_CHECK(!matrix.Open(fileName));
+    BOOST_CHECK(!matrix.Open((root / "missing.bin").string()));
+
+    boost::filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE( embedder_weights )
+{
+    const boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(root);
+    const std::string textName = (root / "matrix.txt").string();
+    const std::string binaryName = (root / "matrix.bin").string();
+
+    // Rows of the notebooks are comma separated, the shape is not fixed
+    std::ofstream(textName) << "1.5, -2,3e-2\n0,0.25 ,7\n\n";
+    const TEmbedderWeights weights = ReadEmbedderWeights(textName);
+    BOOST_REQUIRE_EQUAL(weights.rows(), 2);
+    BOOST_REQUIRE_EQUAL(weights.cols(), 3);
+    BOOST_CHECK_EQUAL(weights(0, 0), 1.5f);
+    BOOST_CHECK_EQUAL(weights(0, 2), 3e-2f);
+    BOOST_CHECK_EQUAL(weights(1, 1), 0.25f);
+    BOOST_CHECK_EQUAL(weights(1, 2), 7.0f);
+
+    BOOST_REQUIRE(TMappedMatrix::Save(binaryName, weights.data(), weights.rows(), weights.cols()));
+    BOOST_CHECK(ReadEmbedderWeights(binaryName) == weights);
+
+    std::ofstream(textName) << "1,2\n3\n";
+    BOOST_CHECK_THROW(ReadEmbedderWeights(textName), std::runtime_error);
+    std::ofstream(textName) << "1,x\n";
+    BOOST_CHECK_THROW(ReadEmbedderWeights(textName), std::runtime_error);
+    BOOST_CHECK_THROW(ReadEmbedderWeights((root / "missing.txt").string()), std::runtime_error);
+
+    boost::filesystem::remove_all(root);
+}
@@ -7,9 +7,12 @@
 
 #include "../src/document.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <fstream>
 #include <iostream>
+#include <random>
 
 BOOST_AUTO_TEST_CASE( parser )
 {
@@ -26,3 +29,304 @@ BOOST_AUTO_TEST_CASE( parser )
     BOOST_REQUIRE_EQUAL(htmlDocument.Author, jsonDocument.Author);
 }
 
+
+namespace {
+
+struct TParseOutcome {
+    bool IsParsed = false;
+    std::string Error;
+    TDocument Document;
+};
+
+TParseOutcome ParseWith(const std::string& path, EHtmlParser parser, const TDocumentLimits& limits) {
+    TParseOutcome outcome;
+    try {
+        outcome.Document.FromHtml(path.c_str(), /* parseLinks = */ true, false, 200, parser, nullptr, 0, limits);
+        outcome.IsParsed = true;
+    } catch (const std::exception& e) {
+        outcome.Error = e.what();
+    }
+    return outcome;
+}
+
+bool CheckParsersAgree(const std::string& html, const TDocumentLimits& limits = TDocumentLimits()) {
+    const boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("%%%%-%%%%.html");
+    {
+        std::ofstream out(path.string(), std::ios::binary);
+        out << html;
+    }
+    const TParseOutcome streaming = ParseWith(path.string(), HP_STREAMING, limits);
+    const TParseOutcome tinyxml = ParseWith(path.string(), HP_TINYXML, limits);
+    boost::filesystem::remove(path);
+
+    BOOST_TEST_CONTEXT(html) {
+        BOOST_REQUIRE_EQUAL(streaming.IsParsed, tinyxml.IsParsed);
+        BOOST_REQUIRE_EQUAL(streaming.Error, tinyxml.Error);
+        if (!streaming.IsParsed) {
+            return false;
+        }
+        const TDocument& s = streaming.Document;
+        const TDocument& t = tinyxml.Document;
+        BOOST_REQUIRE_EQUAL(s.Title, t.Title);
+        BOOST_REQUIRE_EQUAL(s.Url, t.Url);
+        BOOST_REQUIRE_EQUAL(s.SiteName, t.SiteName);
+        BOOST_REQUIRE_EQUAL(s.Description, t.Description);
+        BOOST_REQUIRE_EQUAL(s.FetchTime, t.FetchTime);
+        BOOST_REQUIRE_EQUAL(s.Text, t.Text);
+        BOOST_REQUIRE_EQUAL(s.PubTime, t.PubTime);
+        BOOST_REQUIRE_EQUAL(s.Author, t.Author);
+        BOOST_REQUIRE(s.OutLinks == t.OutLinks);
+        BOOST_REQUIRE_EQUAL(s.TruncatedLimits, t.TruncatedLimits);
+    }
+    return true;
+}
+
+std::string ReadFile(const char* fileName) {
+    std::ifstream in(fileName, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( streaming_parser )
+{
+    const char* testHtmlFile = STR(TEST_PATH)"/data/example1.html";
+    BOOST_REQUIRE(CheckParsersAgree(ReadFile(testHtmlFile)));
+
+    const std::string head = "<html><head><meta property=\"og:title\" content=\"T\"/></head>";
+    const std::vector<std::string> pages = {
+        "",
+        "   ",
+        "<html/>",
+        "<html><head/></html>",
+        head + "</html>",
+        head + "<body><article/></body></html>",
+        head + "<body><article><p>a &amp; b &lt;c&gt; &#1087;&#x440; &unknown; &#xZZ; &#0;tail</p></article></body></html>",
+        head + "<body><article><p>x&amp;y &bogus; z</p></article></body></html>",
+        head + "<body><article><p>  lead <b>bold</b> trail  </p>\r\n<p><![CDATA[raw &amp; <data>]]></p><p/></article></body></html>",
+        head + "<body><article><p>one<!-- comment --><a href=\"http://a\">two<a href='http://b'/></a></p><div><p>skip</p></div></article></body></html>",
+        head + "<body><article><p>a</p><address><time datetime=\"2019-11-01T00:32:00+03:00\"/><a rel=\"author\">Who</a></address></article></body></html>",
+        head + "<body><article><address><time>no</time><a rel=\"author\"><![CDATA[Name]]></a></address></article></body></html>",
+        head + "<body><article><address><a href=\"x\">not author</a><a rel=\"author\">late</a></address></article></body></html>",
+        "<html><head><meta property=\"article:published_time\" content=\"bad\"/></head><body/></html>",
+        head + "<body><article><p>unclosed</article></body></html>",
+        head + "<body><article><p>text</p></article></body></html> trailing",
+        head + "<body><article><p>text</p></article></body></html><!-- broken",
+        head + "<body><article><p>text</p></article></body></html></extra>",
+        "</stray>" + head + "<body><article><p>text</p></article></body></html>",
+        "<?xml version=\"1.0\"?><!DOCTYPE html>" + head + "<body><article><p>t</p></article></body></html>",
+        "<!DOCTYPE html><?xml version=\"1.0\"?>" + head + "<body><article><p>t</p></article></body></html>",
+        "<html><head><meta property=\"og:title\" property=\"x\" content=\"T\"/></head></html>",
+        "<html ><head><meta property = 'og:url' content='u'></meta><meta content=\"no property\"/></head><body><article><p>t</p></article></body></html>",
+        "<html><head><meta property=\"og:title\" content=\"T\"/></head><head><meta property=\"og:url\" content=\"U\"/></head></html>",
+        head + "<body><article><p>a</p></article><article><p>b</p></article></body><body/></html>",
+        "<other><html/></other>" + head + "<body><article><p>t</p></article></body></html>",
+        head + "<body><article><p>nul\0after</p></article></body></html>",
+        "\xEF\xBB\xBF" + head + "<body><article><p>bom</p></article></body></html>",
+        head + "<body><article><p>a</p></article></body></html><"
+    };
+    size_t parsedCount = 0;
+    for (const std::string& page : pages) {
+        parsedCount += CheckParsersAgree(page);
+    }
+    BOOST_REQUIRE_EQUAL(parsedCount, 17);
+
+    // tinyxml2 gives up on the 99th nested element
+    for (size_t nesting = 93; nesting < 97; nesting++) {
+        std::string deep = head + "<body><article><p>";
+        for (size_t depth = 0; depth < nesting; depth++) {
+            deep += "<b>x";
+        }
+        for (size_t depth = 0; depth < nesting; depth++) {
+            deep += "</b>";
+        }
+        const bool isParsed = CheckParsersAgree(deep + "</p></article></body></html>");
+        BOOST_REQUIRE_EQUAL(isParsed, nesting < 95);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( streaming_parser_mutations )
+{
+    const std::string original = ReadFile(STR(TEST_PATH)"/data/example1.html");
+    const std::string alphabet = "<>/!?-[]&#;\"' \r\nap";
+    std::mt19937 generator(42);
+    size_t parsedCount = 0;
+    for (size_t i = 0; i < 300; i++) {
+        std::string page = original;
+        const size_t mutationsCount = 1 + generator() % 3;
+        for (size_t j = 0; j < mutationsCount; j++) {
+            const size_t position = generator() % page.size();
+            if (generator() % 2 == 0) {
+                page.erase(position, 1 + generator() % 4);
+            } else {
+                page.insert(position, 1, alphabet[generator() % alphabet.size()]);
+            }
+        }
+        parsedCount += CheckParsersAgree(page);
+    }
+    BOOST_REQUIRE_GT(parsedCount, 0);
+}
+
+BOOST_AUTO_TEST_CASE( staged_parser )
+{
+    const std::string head = "<html><head><meta property=\"og:title\" content=\"T\"/><meta property=\"og:description\" content=\"D\"/></head>";
+    const std::string longText = std::string(150, 'w');
+    const std::vector<std::string> pages = {
+        ReadFile(STR(TEST_PATH)"/data/example1.html"),
+        head + "<body><article><p>short</p><p>" + longText + "</p></article></body></html>",
+        head + "<body><article><p>short</p></article><p>outside</p></body></html>",
+        "<html><body><article><p>" + longText + "</p></article></body><head><meta property=\"og:title\" content=\"Late\"/></head></html>"
+    };
+    const size_t textLength = 100;
+    for (const std::string& page : pages) {
+        TDocument full;
+        full.FromHtmlBuffer(page.data(), page.size(), /* parseLinks = */ true);
+        const std::string expected = full.Title + "|" + full.Description + "|" + full.Text.substr(0, textLength);
+
+        for (bool isWanted : {true, false}) {
+            std::string seen;
+            size_t callsCount = 0;
+            auto filter = [&](TDocument& doc) {
+                seen = doc.Title + "|" + doc.Description + "|" + doc.Text.substr(0, textLength);
+                callsCount++;
+                return isWanted;
+            };
+            TDocument staged;
+            const size_t skipped = staged.FromHtmlBuffer(page.data(), page.size(), true, false, 200, filter, textLength);
+            BOOST_REQUIRE_EQUAL(callsCount, 1);
+            BOOST_REQUIRE_EQUAL(seen, expected);
+            if (isWanted) {
+                BOOST_REQUIRE_EQUAL(skipped, 0);
+                BOOST_REQUIRE_EQUAL(staged.Text, full.Text);
+                BOOST_REQUIRE_EQUAL(staged.Url, full.Url);
+                BOOST_REQUIRE_EQUAL(staged.FetchTime, full.FetchTime);
+                BOOST_REQUIRE(staged.OutLinks == full.OutLinks);
+            }
+        }
+    }
+
+    // The body of a long page is not parsed at all once the filter declines
+    TDocument doc;
+    const size_t skipped = doc.FromHtmlBuffer(pages[0].data(), pages[0].size(), false, false, 200,
+        [](TDocument&) { return false; }, textLength);
+    BOOST_REQUIRE_GT(skipped, pages[0].size() / 2);
+}
+
+BOOST_AUTO_TEST_CASE( document_limits )
+{
+    const std::string head = "<html><head><meta property=\"og:title\" content=\"T\"/></head>";
+    const std::string page = head + "<body><article>"
+        "<p>Первый <a href=\"http://a\">абзац</a></p>"
+        "<p>second <a href=\"http://b\">one</a><a href=\"http://c\">two</a></p>"
+        "<p>третий</p>"
+        "<address><a rel=\"author\">Who</a></address>"
+        "</article></body></html>";
+    TDocumentLimits limits;
+    BOOST_REQUIRE(CheckParsersAgree(page, limits));
+
+    // Both parsers make the same cuts, the address after them is still read
+    for (size_t maxParagraphs : {1, 2, 3}) {
+        limits = TDocumentLimits();
+        limits.MaxParagraphs = maxParagraphs;
+        BOOST_REQUIRE(CheckParsersAgree(page, limits));
+    }
+    for (size_t maxTextLength = 1; maxTextLength < 40; maxTextLength++) {
+        limits = TDocumentLimits();
+        limits.MaxTextLength = maxTextLength;
+        BOOST_REQUIRE(CheckParsersAgree(page, limits));
+    }
+    for (size_t maxOutLinks : {1, 2, 3}) {
+        limits = TDocumentLimits();
+        limits.MaxOutLinks = maxOutLinks;
+        BOOST_REQUIRE(CheckParsersAgree(page, limits));
+    }
+
+    limits = TDocumentLimits();
+    limits.MaxParagraphs = 2;
+    limits.MaxTextLength = 11;
+    limits.MaxOutLinks = 1;
+    TDocument doc;
+    doc.FromHtmlBuffer(page.data(), page.size(), /* parseLinks = */ true, false, 200, nullptr, 0, limits);
+    // Cyrillic letters take two bytes, the text is not cut inside one
+    BOOST_CHECK_EQUAL(doc.Text, "Первы\n");
+    BOOST_CHECK((doc.OutLinks == std::vector<std::string>{"http://a"}));
+    BOOST_CHECK_EQUAL(doc.Author, "Who");
+    BOOST_CHECK_EQUAL(doc.TruncatedLimits, 1u << DL_TEXT_LENGTH);
+
+    // A page cut by the byte limit keeps everything before the cut
+    const std::string original = ReadFile(STR(TEST_PATH)"/data/example1.html");
+    TDocument full;
+    full.FromHtmlBuffer(original.data(), original.size());
+    BOOST_REQUIRE_EQUAL(full.TruncatedLimits, 0);
+    size_t cutCount = 0;
+    for (size_t maxBytes = 1500; maxBytes < original.size(); maxBytes += 97) {
+        limits = TDocumentLimits();
+        limits.MaxBytes = maxBytes;
+        TDocument cut;
+        cut.FromHtmlBuffer(original.data(), original.size(), false, false, 200, nullptr, 0, limits);
+        BOOST_REQUIRE_EQUAL(cut.Title, full.Title);
+        BOOST_REQUIRE_EQUAL(cut.TruncatedLimits, 1u << DL_BYTES);
+        BOOST_REQUIRE(!cut.Text.empty() && cut.Text.back() == '\n');
+        BOOST_REQUIRE_EQUAL(full.Text.compare(0, cut.Text.size() - 1, cut.Text, 0, cut.Text.size() - 1), 0);
+        BOOST_REQUIRE_LT(cut.Text.size(), full.Text.size());
+        cutCount++;
+    }
+    BOOST_REQUIRE_GT(cutCount, 0);
+    // Files are mapped only up to the byte past the limit, the cut is the same
+    limits = TDocumentLimits();
+    limits.MaxBytes = 1985;
+    TDocument cutBuffer;
+    cutBuffer.FromHtmlBuffer(original.data(), original.size(), false, false, 200, nullptr, 0, limits);
+    TDocument cutFile;
+    cutFile.FromHtml(STR(TEST_PATH)"/data/example1.html", false, false, 200, HP_STREAMING, nullptr, 0, limits);
+    BOOST_CHECK_EQUAL(cutFile.Text, cutBuffer.Text);
+    BOOST_CHECK_EQUAL(cutFile.TruncatedLimits, 1u << DL_BYTES);
+    // A cut before the article loses it, an error in a complete tag is still an error
+    limits = TDocumentLimits();
+    limits.MaxBytes = 700;
+    BOOST_CHECK_THROW(doc.FromHtmlBuffer(original.data(), original.size(), false, false, 200, nullptr, 0, limits), std::runtime_error);
+    const std::string broken = head + "<body><article><p>text</b></p>" + std::string(100, ' ') + "</article></body></html>";
+    limits.MaxBytes = broken.size() - 50;
+    BOOST_CHECK_THROW(doc.FromHtmlBuffer(broken.data(), broken.size(), false, false, 200, nullptr, 0, limits), std::runtime_error);
+    limits.MaxBytes = 0;
+    BOOST_CHECK_THROW(doc.FromHtmlBuffer(broken.data(), broken.size(), false, false, 200, nullptr, 0, limits), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( parse_status )
+{
+    const std::string head = "<html><head><meta property=\"og:title\" content=\"T\"/></head>";
+    const std::vector<std::pair<std::string, EParseStatus>> pages = {
+        {head + "<body><article><p>t</p></article></body></html>", PS_OK},
+        {"", PS_NO_HTML},
+        {"<html><p>unclosed</html>", PS_NO_HTML},
+        {"<html/>", PS_NO_HEAD},
+        {"<html><head/></html>", PS_NO_META},
+        {head + "</html>", PS_NO_BODY},
+        {head + "<body/></html>", PS_NO_ARTICLE},
+        {"<html><head><meta property=\"article:published_time\" content=\"bad\"/></head><body/></html>", PS_BAD_DATE},
+        {head + "<body><article><address><time datetime=\"bad\"/></address></article></body></html>", PS_BAD_DATE},
+    };
+    for (const auto& page : pages) {
+        TDocument doc;
+        size_t skippedBytes = 1;
+        const EParseStatus status = doc.TryFromHtmlBuffer(page.first.data(), page.first.size(), skippedBytes);
+        BOOST_CHECK_EQUAL(status, page.second);
+        BOOST_CHECK_EQUAL(skippedBytes, 0);
+        // The throwing API reports the same
+        TDocument thrown;
+        if (page.second == PS_OK) {
+            BOOST_CHECK_NO_THROW(thrown.FromHtmlBuffer(page.first.data(), page.first.size()));
+        } else {
+            try {
+                thrown.FromHtmlBuffer(page.first.data(), page.first.size());
+                BOOST_ERROR("No exception for " << page.first);
+            } catch (const std::runtime_error& e) {
+                BOOST_CHECK_EQUAL(std::string(e.what()), GetParseError(page.second));
+            }
+        }
+    }
+    size_t skippedBytes = 0;
+    TDocument doc;
+    BOOST_CHECK_EQUAL(doc.TryFromHtml("no/such/file.html", skippedBytes), PS_NO_FILE);
+    BOOST_CHECK_EQUAL(doc.TryFromHtml("no/such/file.html", skippedBytes, false, false, 200, HP_TINYXML), PS_NO_FILE);
+}
@@ -0,0 +1,83 @@
+#define BOOST_TEST_DYN_LINK
+
+#define BOOST_TEST_MODULE "TarReaderModule"
+
+#include "../src/tar_reader.h"
+#include "../src/util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <random>
+
+BOOST_AUTO_TEST_CASE( tar_reader )
+{
+    const boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    const boost::filesystem::path data = root / "data";
+    std::mt19937 generator(42);
+    std::map<std::string, std::string> expected;
+    for (size_t i = 0; i < 50; i++) {
+        // Long paths need a ustar prefix, a GNU long name or a pax record
+        std::string directory = "data/" + std::to_string(i % 5);
+        if (i % 10 == 0) {
+            directory += "/" + std::string(120, 'd');
+        }
+        std::string name = std::to_string(i);
+        if (i % 7 == 0) {
+            name += std::string(110, 'n');
+        }
+        name += (i % 8 == 0) ? ".txt" : ".html";
+        // Some sizes are multiples of the block size
+        const size_t size = (i % 9 == 0) ? 1024 : generator() % 3000;
+        std::string content(size, '\0');
+        for (char& ch : content) {
+            ch = static_cast<char>(generator());
+        }
+        boost::filesystem::create_directories(root / directory);
+        std::ofstream((root / directory / name).string(), std::ios::binary) << content;
+        expected[directory + "/" + name] = content;
+    }
+
+    for (const std::string format : {"gnu", "pax", "ustar"}) {
+        for (const std::string extension : {".tar", ".tar.gz"}) {
+            const std::string archiveName = (root / (format + extension)).string();
+            const std::string command = "tar -C " + root.string() + " --format=" + format
+                + (extension == ".tar" ? " -cf " : " -czf ") + archiveName + " data 2>/dev/null";
+            if (std::system(command.c_str()) != 0) {
+                // ustar can't store the longest names
+                BOOST_CHECK_EQUAL(format, "ustar");
+                continue;
+            }
+            BOOST_CHECK(IsTarArchive(archiveName));
+
+            // The budget is smaller than the largest member, buffers are released right away
+            TTarReader reader(archiveName, /* maxBytesInFlight = */ 1000);
+            std::map<std::string, std::string> results;
+            while (TFileDataPtr member = reader.Next()) {
+                BOOST_CHECK(member->IsRead());
+                BOOST_CHECK(results.emplace(member->GetFileName(), std::string(member->Data(), member->Size())).second);
+            }
+            BOOST_CHECK(!reader.Next());
+            BOOST_CHECK_EQUAL(results.size(), expected.size());
+            for (const auto& pair : expected) {
+                const auto it = results.find(pair.first);
+                BOOST_REQUIRE(it != results.end());
+                BOOST_CHECK(it->second == pair.second);
+                BOOST_CHECK_EQUAL(CleanFileName(it->first), CleanFileName((root / pair.first).string()));
+            }
+        }
+    }
+    BOOST_CHECK(!IsTarArchive(data.string()));
+    BOOST_CHECK_THROW(TTarReader((root / "missing.tar").string()), std::runtime_error);
+
+    // Not a tar archive at all
+    const std::string brokenName = (root / "broken.tar").string();
+    std::ofstream(brokenName, std::ios::binary) << std::string(2048, 'x');
+    TTarReader brokenReader(brokenName);
+    BOOST_CHECK_THROW(brokenReader.Next(), std::runtime_error);
+
+    boost::filesystem::remove_all(root);
+}
@@ -0,0 +1,202 @@
+#define BOOST_TEST_DYN_LINK
+
+#define BOOST_TEST_MODULE "UtilModule"
+
+#include "../src/thread_pool.h"
+#include "../src/util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <random>
+#include <regex>
+
+namespace {
+
+// DateToTimestamp before it was rewritten without std::regex and timegm
+uint64_t DateToTimestampWithRegex(const std::string& date) {
+    std::regex ex("(\\d\\d\\d\\d)-(\\d\\d)-(\\d\\d)T(\\d\\d):(\\d\\d):(\\d\\d)([+-])(\\d\\d):(\\d\\d)");
+    std::smatch what;
+    if (!std::regex_match(date, what, ex) || what.size() < 10) {
+        throw std::runtime_error("wrong date format");
+    }
+    std::tm t = {};
+    t.tm_sec = std::stoi(what[6]);
+    t.tm_min = std::stoi(what[5]);
+    t.tm_hour = std::stoi(what[4]);
+    t.tm_mday = std::stoi(what[3]);
+    t.tm_mon = std::stoi(what[2]) - 1;
+    t.tm_year = std::stoi(what[1]) - 1900;
+
+    time_t timestamp = timegm(&t);
+    uint64_t zone_ts = std::stoi(what[8]) * 60 * 60 + std::stoi(what[9]) * 60;
+    if (what[7] == "+") {
+        timestamp = timestamp - zone_ts;
+    } else if (what[7] == "-") {
+        timestamp = timestamp + zone_ts;
+    }
+    return timestamp > 0 ? timestamp : 0;
+}
+
+// GetHost before it was rewritten without std::regex
+std::string GetHostWithRegex(const std::string& url) {
+    std::regex ex("(http|https)://(?:www\\.)?([^/ :]+):?([^/ ]*)(/?[^ #?]*)\\x3f?([^ #]*)#?([^ ]*)");
+    std::smatch what;
+    if (std::regex_match(url, what, ex) && what.size() >= 3) {
+        return std::string(what[2].first, what[2].second);
+    }
+    return std::string();
+}
+
+// -1 for the wrong format
+int64_t TryDateToTimestamp(uint64_t (*convert)(const std::string&), const std::string& date) {
+    try {
+        return convert(date);
+    } catch (const std::runtime_error&) {
+        return -1;
+    }
+}
+
+// The sequential walk ReadFileNames has to reproduce
+std::vector<std::string> ReadFileNamesSequentially(const std::string& directory, int nDocs) {
+    std::vector<std::string> fileNames;
+    boost::filesystem::recursive_directory_iterator end;
+    for (auto it = boost::filesystem::recursive_directory_iterator(directory); it != end; it++) {
+        if (boost::filesystem::is_directory(it->path())) {
+            continue;
+        }
+        std::string path = it->path().string();
+        if (path.substr(path.length() - 5) == ".html") {
+            fileNames.push_back(path);
+        }
+        if (nDocs != -1 && fileNames.size() == static_cast<size_t>(nDocs)) {
+            break;
+        }
+    }
+    return fileNames;
+}
+
+void CreateFile(const boost::filesystem::path& path) {
+    std::ofstream out(path.string());
+    out << "<html/>";
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( read_file_names )
+{
+    const boost::filesystem::path root = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(root / "empty");
+    for (size_t day = 0; day < 3; day++) {
+        for (size_t hour = 0; hour < 4; hour++) {
+            const boost::filesystem::path hourPath = root / ("2019110" + std::to_string(day)) / std::to_string(hour);
+            boost::filesystem::create_directories(hourPath);
+            for (size_t i = 0; i < 20; i++) {
+                CreateFile(hourPath / (std::to_string(i) + ".html"));
+            }
+            CreateFile(hourPath / "skipped.txt");
+        }
+        CreateFile(root / ("top" + std::to_string(day) + ".html"));
+    }
+    boost::filesystem::create_directory_symlink(root / "20191100", root / "link.html");
+    boost::filesystem::create_symlink(root / "top0.html", root / "file_link.html");
+
+    TThreadPool threadPool(4);
+    for (int nDocs : {-1, 0, 1, 17, 100, 1000}) {
+        const std::vector<std::string> expected = ReadFileNamesSequentially(root.string(), nDocs);
+
+        std::vector<std::string> fileNames;
+        ReadFileNames(root.string(), fileNames, nDocs);
+        BOOST_REQUIRE(fileNames == expected);
+
+        for (bool sortByInode : {false, true}) {
+            std::map<size_t, std::string> indexToFileName;
+            ReadFileNames(root.string(), threadPool, [&](size_t index, const std::string& fileName) {
+                BOOST_REQUIRE(indexToFileName.emplace(index, fileName).second);
+            }, nDocs, sortByInode);
+            BOOST_REQUIRE_EQUAL(indexToFileName.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); i++) {
+                BOOST_REQUIRE_EQUAL(indexToFileName.at(i), expected[i]);
+            }
+        }
+    }
+    boost::filesystem::remove_all(root);
+}
+
+BOOST_AUTO_TEST_CASE( date_to_timestamp )
+{
+    BOOST_CHECK_EQUAL(DateToTimestamp("2020-01-03T14:20:00+03:00"), 1578050400);
+    BOOST_CHECK_EQUAL(DateToTimestamp("1970-01-01T00:00:00+00:00"), 0);
+    BOOST_CHECK_THROW(DateToTimestamp("2020-01-03 14:20:00+03:00"), std::runtime_error);
+    BOOST_CHECK_THROW(DateToTimestamp("2020-01-03T14:20:00Z"), std::runtime_error);
+    uint64_t timestamp = 0;
+    BOOST_CHECK(ParseDate("2020-01-03T14:20:00+03:00", timestamp));
+    BOOST_CHECK_EQUAL(timestamp, 1578050400);
+    BOOST_CHECK(!ParseDate("2020-01-03T14:20:00Z", timestamp));
+
+    std::mt19937 generator(42);
+    auto digits = [&generator](size_t count, int maxValue) {
+        std::string value = std::to_string(generator() % (maxValue + 1));
+        return std::string(count - std::min(count, value.size()), '0') + value;
+    };
+    const std::string alphabet = "0123456789-+:TZ .";
+    size_t validCount = 0;
+    for (size_t i = 0; i < 5000; i++) {
+        // Mostly real dates, some fields out of their ranges and some broken strings
+        const bool isWide = i % 4 == 0;
+        std::string date = digits(4, i % 8 == 0 ? 9999 : 2100) + "-"
+            + digits(2, isWide ? 99 : 12) + "-"
+            + digits(2, isWide ? 99 : 31) + "T"
+            + digits(2, isWide ? 99 : 23) + ":"
+            + digits(2, isWide ? 99 : 59) + ":"
+            + digits(2, isWide ? 99 : 60)
+            + (generator() % 2 ? "+" : "-")
+            + digits(2, isWide ? 99 : 14) + ":"
+            + digits(2, isWide ? 99 : 59);
+        if (i % 5 == 0) {
+            const size_t position = generator() % (date.size() + 1);
+            switch (generator() % 3) {
+                case 0:
+                    date.insert(position, 1, alphabet[generator() % alphabet.size()]);
+                    break;
+                case 1:
+                    date.erase(std::min(position, date.size() - 1), 1);
+                    break;
+                default:
+                    date[std::min(position, date.size() - 1)] = alphabet[generator() % alphabet.size()];
+            }
+        }
+        const int64_t expected = TryDateToTimestamp(DateToTimestampWithRegex, date);
+        if (TryDateToTimestamp(DateToTimestamp, date) != expected) {
+            BOOST_ERROR("Different timestamps for " << date);
+        }
+        validCount += expected != -1 ? 1 : 0;
+    }
+    BOOST_CHECK_GT(validCount, 3500);
+}
+
+BOOST_AUTO_TEST_CASE( get_host )
+{
+    BOOST_CHECK_EQUAL(GetHost("https://www.rbc.ru/politics/01/01/2020/1.shtml?from=main#top"), "rbc.ru");
+    BOOST_CHECK_EQUAL(GetHost("http://lenta.ru:8080/news"), "lenta.ru");
+    BOOST_CHECK_EQUAL(GetHost("http://www.:8080/news"), "www.");
+    BOOST_CHECK_EQUAL(GetHost("ftp://lenta.ru/news"), "");
+    BOOST_CHECK_EQUAL(GetHost("https://lenta.ru/news with space"), "");
+
+    std::mt19937 generator(42);
+    const std::vector<std::string> parts = {
+        "http://", "https://", "HTTP://", "http:/", "www.", "www", ".", "lenta", "ru", "/", ":", "8080",
+        "?", "#", "=", "&", " ", "-", "news", "https", "x"
+    };
+    for (size_t i = 0; i < 5000; i++) {
+        std::string url = (i % 4 == 0) ? "" : parts[generator() % 2];
+        const size_t partsCount = generator() % 10;
+        for (size_t j = 0; j < partsCount; j++) {
+            url += parts[generator() % parts.size()];
+        }
+        BOOST_REQUIRE_EQUAL(GetHost(url), GetHostWithRegex(url));
+    }
+}